@@ -0,0 +1,321 @@
+#ifndef GRID_FORMAT_H
+#define GRID_FORMAT_H
+
+/**
+ * Self describing container for grids of doubles, shared by the grid writers, readers and the solver
+ *
+ * A file is a GridFileHeader, followed by an index of chunk_count GridChunk entries, followed by the chunks themselves.
+ * Each chunk holds chunk_rows whole rows (the last may hold fewer), stored raw or compressed with the header's codec,
+ * so a reader can go straight to the chunks covering the rows it wants.
+ * All fields are stored in the byte order of the machine that wrote the file, which byte_order records.
+ *
+ * Every program here is a single translation unit, so the functions are defined static inline in this header.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_FILE_MAGIC "LAPGRID"
+#define GRID_FILE_VERSION 1
+#define GRID_BYTE_ORDER 0x01020304u
+
+// types of value held in a grid file
+#define GRID_DTYPE_FLOAT64 1
+
+// ways chunks can be stored
+#define GRID_CODEC_NONE 0
+#define GRID_CODEC_XOR_RUNS 1 // each value XORed with the one before, runs of zero words skipped (see gridCompress)
+
+// boundary conditions the grid is for
+#define GRID_BOUNDARY_FIXED_EDGES 1 // the outermost rows and columns hold fixed values
+
+// uncompressed bytes each chunk is sized to hold
+#define GRID_CHUNK_BYTES (1 << 20)
+
+/**
+ * Header at the start of every grid file
+ */
+typedef struct
+{
+    char magic[8]; // GRID_FILE_MAGIC
+    uint32_t version;
+    uint32_t byte_order; // GRID_BYTE_ORDER as written, so files from a machine of the other byte order are recognised
+    uint32_t dtype;
+    uint32_t codec;
+    uint32_t boundary;
+    uint32_t reserved;
+    uint64_t rows;
+    uint64_t columns;
+    uint64_t chunk_rows;
+    uint64_t chunk_count;
+    uint64_t index_checksum; // gridChecksum of the chunk index, which holds each chunk's own checksum
+} GridFileHeader;
+
+/**
+ * Index entry for one chunk of a grid file
+ */
+typedef struct
+{
+    uint64_t offset;   // from the start of the file
+    uint64_t bytes;    // as stored, after any compression
+    uint64_t checksum; // gridChecksum of the chunk's values before compression
+} GridChunk;
+
+/**
+ * Streams a grid file out one chunk at a time, so the whole grid never has to be held in memory
+ */
+typedef struct
+{
+    FILE *file;
+    GridFileHeader header;
+    GridChunk *chunks;
+    uint64_t next_chunk;
+    uint64_t offset; // where the next chunk goes
+    unsigned char *buffer;
+} GridFileWriter;
+
+/**
+ * 64 bit FNV-1a hash of a block of memory, taken a word at a time
+ */
+static inline uint64_t gridChecksum(const void *data, size_t bytes)
+{
+    const unsigned char *in = data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, in + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+    for (; i < bytes; i++)
+    {
+        hash = (hash ^ in[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/**
+ * Rows per chunk for a grid of the given width, so each chunk holds about GRID_CHUNK_BYTES
+ */
+static inline uint64_t gridDefaultChunkRows(uint64_t columns)
+{
+    uint64_t rows = GRID_CHUNK_BYTES / (sizeof(double) * columns);
+    return rows > 0 ? rows : 1;
+}
+
+/**
+ * The most bytes gridCompress can produce for count values
+ */
+static inline size_t gridCompressBound(size_t count)
+{
+    // runs of zero words split the literals into at most count / 2 + 1 groups, each led by two varints of at most 10 bytes
+    return count * sizeof(double) + (count / 2 + 2) * 20;
+}
+
+static inline unsigned char *gridPutVarint(unsigned char *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+static inline const unsigned char *gridGetVarint(const unsigned char *in, const unsigned char *end, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *in++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Losslessly compresses count doubles into out (which must hold gridCompressBound(count) bytes), returning the bytes used
+ * each value is XORed with the one before it, so repeated values become zero words, and the result is written as
+ * groups of a varint count of zero words, a varint count of literal words and the literal words themselves
+ * grids with large areas of equal values (such as the simple grids, which are almost entirely 0) shrink to a tiny fraction
+ */
+static inline size_t gridCompress(const double *values, size_t count, unsigned char *out)
+{
+    unsigned char *start = out;
+    uint64_t previous = 0;
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t zeros = 0;
+        uint64_t word;
+        while (i < count && (memcpy(&word, &values[i], 8), word == previous))
+        {
+            zeros++;
+            i++;
+        }
+
+        size_t literal_start = i;
+        uint64_t literal_previous = previous;
+        while (i < count && (memcpy(&word, &values[i], 8), word != previous))
+        {
+            previous = word;
+            i++;
+        }
+
+        out = gridPutVarint(out, zeros);
+        out = gridPutVarint(out, i - literal_start);
+        for (size_t j = literal_start; j < i; j++)
+        {
+            memcpy(&word, &values[j], 8);
+            uint64_t delta = word ^ literal_previous;
+            memcpy(out, &delta, 8);
+            out += 8;
+            literal_previous = word;
+        }
+    }
+    return (size_t)(out - start);
+}
+
+/**
+ * Reverses gridCompress, filling values with exactly count doubles
+ * returns 0 on success, -1 if the data is corrupt
+ */
+static inline int gridDecompress(const unsigned char *in, size_t bytes, double *values, size_t count)
+{
+    const unsigned char *end = in + bytes;
+    uint64_t previous = 0;
+    size_t i = 0;
+    while (i < count)
+    {
+        uint64_t zeros, literals;
+        if ((in = gridGetVarint(in, end, &zeros)) == NULL || (in = gridGetVarint(in, end, &literals)) == NULL ||
+            zeros > count - i || literals > count - i - zeros || (uint64_t)(end - in) < literals * 8)
+        {
+            return -1;
+        }
+        for (uint64_t j = 0; j < zeros; j++)
+        {
+            memcpy(&values[i++], &previous, 8);
+        }
+        for (uint64_t j = 0; j < literals; j++)
+        {
+            uint64_t delta;
+            memcpy(&delta, in, 8);
+            in += 8;
+            previous ^= delta;
+            memcpy(&values[i++], &previous, 8);
+        }
+    }
+    return in == end ? 0 : -1;
+}
+
+/**
+ * Fills in the header for a grid of the given size, working out the number of chunks
+ */
+static inline void gridInitHeader(GridFileHeader *header, uint64_t rows, uint64_t columns, uint64_t chunk_rows, uint32_t codec)
+{
+    memset(header, 0, sizeof(GridFileHeader));
+    memcpy(header->magic, GRID_FILE_MAGIC, sizeof(header->magic));
+    header->version = GRID_FILE_VERSION;
+    header->byte_order = GRID_BYTE_ORDER;
+    header->dtype = GRID_DTYPE_FLOAT64;
+    header->codec = codec;
+    header->boundary = GRID_BOUNDARY_FIXED_EDGES;
+    header->rows = rows;
+    header->columns = columns;
+    header->chunk_rows = chunk_rows;
+    header->chunk_count = (rows + chunk_rows - 1) / chunk_rows;
+}
+
+/**
+ * Checks a header read from a file
+ * returns 0 if it is a grid file this code can read, 1 if it is not a grid file at all (a raw grid of doubles),
+ * or -1 if it is a grid file that cannot be read, with a description of the problem in error
+ */
+static inline int gridCheckHeader(const GridFileHeader *header, const char **error)
+{
+    if (memcmp(header->magic, GRID_FILE_MAGIC, sizeof(header->magic)) != 0)
+    {
+        return 1;
+    }
+    *error = header->byte_order != GRID_BYTE_ORDER ? "written on a machine of the other byte order"
+             : header->version != GRID_FILE_VERSION ? "an unsupported version"
+             : header->dtype != GRID_DTYPE_FLOAT64  ? "an unsupported value type"
+             : header->codec > GRID_CODEC_XOR_RUNS  ? "an unsupported codec"
+             : header->chunk_rows == 0 || header->chunk_count != (header->rows + header->chunk_rows - 1) / header->chunk_rows
+                 ? "a corrupt header"
+                 : NULL;
+    return *error != NULL ? -1 : 0;
+}
+
+/**
+ * Creates a grid file and reserves space for its header and index, ready for gridWriterAppend
+ * returns 0 on success, -1 if the file cannot be created
+ */
+static inline int gridWriterOpen(GridFileWriter *writer, const char *path, uint64_t rows, uint64_t columns, uint64_t chunk_rows, uint32_t codec)
+{
+    gridInitHeader(&writer->header, rows, columns, chunk_rows, codec);
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL)
+    {
+        return -1;
+    }
+    writer->chunks = calloc(writer->header.chunk_count, sizeof(GridChunk));
+    writer->buffer = codec == GRID_CODEC_NONE ? NULL : malloc(gridCompressBound(chunk_rows * columns));
+    writer->next_chunk = 0;
+    writer->offset = sizeof(GridFileHeader) + writer->header.chunk_count * sizeof(GridChunk);
+    return fseek(writer->file, (long)writer->offset, SEEK_SET) == 0 ? 0 : -1;
+}
+
+/**
+ * Writes the next chunk of a grid file, from rows contiguous rows of values
+ * (chunk_rows of them, apart from the last chunk, which holds whatever rows remain)
+ * returns 0 on success, -1 on a write error
+ */
+static inline int gridWriterAppend(GridFileWriter *writer, const double *values, uint64_t rows)
+{
+    size_t count = (size_t)(rows * writer->header.columns);
+    GridChunk *chunk = &writer->chunks[writer->next_chunk++];
+    chunk->offset = writer->offset;
+    chunk->checksum = gridChecksum(values, count * sizeof(double));
+
+    const void *data = values;
+    chunk->bytes = count * sizeof(double);
+    if (writer->header.codec == GRID_CODEC_XOR_RUNS)
+    {
+        chunk->bytes = gridCompress(values, count, writer->buffer);
+        data = writer->buffer;
+    }
+    writer->offset += chunk->bytes;
+    return fwrite(data, 1, (size_t)chunk->bytes, writer->file) == chunk->bytes ? 0 : -1;
+}
+
+/**
+ * Fills in the index and header of a grid file once all its chunks are written, and closes it
+ * returns 0 on success, -1 on a write error
+ */
+static inline int gridWriterClose(GridFileWriter *writer)
+{
+    size_t index_bytes = (size_t)writer->header.chunk_count * sizeof(GridChunk);
+    writer->header.index_checksum = gridChecksum(writer->chunks, index_bytes);
+
+    int failed = writer->next_chunk != writer->header.chunk_count;
+    failed |= fseek(writer->file, 0, SEEK_SET) != 0;
+    failed |= fwrite(&writer->header, sizeof(GridFileHeader), 1, writer->file) != 1;
+    failed |= fwrite(writer->chunks, 1, index_bytes, writer->file) != index_bytes;
+    failed |= fclose(writer->file) != 0;
+
+    free(writer->chunks);
+    free(writer->buffer);
+    return failed ? -1 : 0;
+}
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef GRID_GENERATOR_H
+#define GRID_GENERATOR_H
+
+/**
+ * Procedural grids, generated a block at a time straight into a grid file (or into a solver's grid)
+ *
+ * Every value comes from a counter based random number generator keyed on the seed and the value's position,
+ * so any block of a grid can be produced on its own, and a grid is identical however many writers produce it.
+ * Files are written in the gridFormat.h format by a number of writers (threads, or threads of each MPI process),
+ * each owning a run of chunks and writing them at their own offsets with pwrite.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "gridFormat.h"
+
+// kinds of grid that can be generated
+#define GRID_GENERATOR_RANDOM 0 // every value 0 or 1 at random
+#define GRID_GENERATOR_SIMPLE 1 // 1s along the top row and left column, 0 everywhere else
+#define GRID_GENERATOR_SINE 2   // sin(pi x) along the top row, 0 everywhere else, the textbook problem with a known series solution
+#define GRID_GENERATOR_LINEAR 3 // edges following (x + y) / 2, interior 0, which relaxes to exactly that plane (handy for checking results)
+
+// what a pass of gridGenerateChunks does
+#define GRID_PASS_SIZE 0  // generate and compress the chunks, only recording their sizes and checksums
+#define GRID_PASS_WRITE 1 // generate the chunks and write them at the offsets in the index
+
+/**
+ * A run of chunks for one writer to generate
+ */
+typedef struct
+{
+    int fd;
+    const GridFileHeader *header;
+    GridChunk *chunks; // the whole file's index, shared by all writers
+    int generator;
+    uint64_t seed;
+    uint64_t first_chunk, end_chunk;
+    int pass;
+    int failed;
+} GridGeneratorJob;
+
+/**
+ * Random 64 bit value for the given counter, from the splitmix64 finaliser applied to the counter mixed with the seed
+ */
+static inline uint64_t gridRandom(uint64_t seed, uint64_t counter)
+{
+    uint64_t z = seed + (counter + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Looks up a generator by name
+ * returns -1 if there is no generator with that name
+ */
+static inline int gridGeneratorFromName(const char *name)
+{
+    return strcmp(name, "random") == 0   ? GRID_GENERATOR_RANDOM
+           : strcmp(name, "simple") == 0 ? GRID_GENERATOR_SIMPLE
+           : strcmp(name, "sine") == 0   ? GRID_GENERATOR_SINE
+           : strcmp(name, "linear") == 0 ? GRID_GENERATOR_LINEAR
+                                         : -1;
+}
+
+/**
+ * Parses a generator given as <name> or, for random grids, random:<seed>
+ * returns 0 on success, -1 if the generator is not recognised (seed is left alone unless one is given)
+ */
+static inline int gridParseGenerator(const char *arg, int *generator, uint64_t *seed)
+{
+    char *end;
+    if (strncmp(arg, "random:", 7) == 0)
+    {
+        *seed = strtoull(arg + 7, &end, 0);
+        *generator = GRID_GENERATOR_RANDOM;
+        return *end == '\0' && end != arg + 7 ? 0 : -1;
+    }
+    *generator = gridGeneratorFromName(arg);
+    return *generator < 0 ? -1 : 0;
+}
+
+/**
+ * Generates a block of a dimension x dimension grid: rows from first_row and columns from first_column,
+ * written out with stride values between the start of each row
+ */
+static inline void gridGenerateBlock(int generator, uint64_t seed, uint64_t dimension, uint64_t first_row, uint64_t rows,
+                                     uint64_t first_column, uint64_t columns, double *out, size_t stride)
+{
+    uint64_t last = dimension - 1;
+    double scale = dimension > 1 ? 1.0 / (double)last : 0;
+    for (uint64_t y = 0; y < rows; y++)
+    {
+        double *row = out + y * stride;
+        uint64_t overall_row = first_row + y;
+        for (uint64_t x = 0; x < columns; x++)
+        {
+            uint64_t overall_column = first_column + x;
+            int edge = overall_row == 0 || overall_row == last || overall_column == 0 || overall_column == last;
+            switch (generator)
+            {
+            case GRID_GENERATOR_SIMPLE:
+                row[x] = overall_row == 0 || overall_column == 0 ? 1 : 0;
+                break;
+            case GRID_GENERATOR_SINE:
+                row[x] = overall_row == 0 ? sin(M_PI * (double)overall_column * scale) : 0;
+                break;
+            case GRID_GENERATOR_LINEAR:
+                row[x] = edge ? 0.5 * (double)(overall_row + overall_column) * scale : 0;
+                break;
+            default:
+                row[x] = (double)(gridRandom(seed, overall_row * dimension + overall_column) >> 63);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Writes all of a buffer at an offset in a file, however many calls it takes
+ * returns 0 on success, -1 on a write error
+ */
+static inline int gridPwriteAll(int fd, const void *buffer, size_t bytes, uint64_t offset)
+{
+    const unsigned char *in = buffer;
+    while (bytes > 0)
+    {
+        ssize_t written = pwrite(fd, in, bytes, (off_t)offset);
+        if (written <= 0)
+        {
+            return -1;
+        }
+        in += written;
+        bytes -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Thread function generating a writer's run of chunks, one chunk at a time, for one pass (see GRID_PASS_SIZE)
+ */
+static inline void *gridGenerateChunks(void *arg)
+{
+    GridGeneratorJob *job = arg;
+    const GridFileHeader *header = job->header;
+    uint64_t columns = header->columns;
+
+    double *values = malloc(sizeof(double) * header->chunk_rows * columns);
+    unsigned char *compressed = header->codec == GRID_CODEC_NONE ? NULL : malloc(gridCompressBound(header->chunk_rows * columns));
+
+    for (uint64_t c = job->first_chunk; c < job->end_chunk && !job->failed; c++)
+    {
+        uint64_t first_row = c * header->chunk_rows;
+        uint64_t rows = header->rows - first_row < header->chunk_rows ? header->rows - first_row : header->chunk_rows;
+        size_t count = (size_t)(rows * columns);
+        gridGenerateBlock(job->generator, job->seed, columns, first_row, rows, 0, columns, values, columns);
+
+        GridChunk *chunk = &job->chunks[c];
+        const void *data = values;
+        chunk->bytes = count * sizeof(double);
+        chunk->checksum = gridChecksum(values, count * sizeof(double));
+        if (compressed != NULL)
+        {
+            chunk->bytes = gridCompress(values, count, compressed);
+            data = compressed;
+        }
+        if (job->pass == GRID_PASS_WRITE && gridPwriteAll(job->fd, data, (size_t)chunk->bytes, chunk->offset) != 0)
+        {
+            job->failed = 1;
+        }
+    }
+
+    free(values);
+    free(compressed);
+    return NULL;
+}
+
+/**
+ * Runs a pass over the chunks from first_chunk to end_chunk, split between the given number of threads
+ * returns 0 on success, -1 if any writer failed
+ */
+static inline int gridRunPass(const GridGeneratorJob *settings, uint64_t first_chunk, uint64_t end_chunk, int pass, int threads)
+{
+    GridGeneratorJob *jobs = malloc(sizeof(GridGeneratorJob) * threads);
+    pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+    uint64_t chunks = end_chunk - first_chunk;
+    int failed = 0;
+
+    for (int i = 0; i < threads; i++)
+    {
+        jobs[i] = *settings;
+        jobs[i].pass = pass;
+        jobs[i].failed = 0;
+        jobs[i].first_chunk = first_chunk + chunks * i / threads;
+        jobs[i].end_chunk = first_chunk + chunks * (i + 1) / threads;
+        if (i > 0 && pthread_create(&ids[i], NULL, gridGenerateChunks, &jobs[i]) != 0)
+        {
+            // run it here instead
+            gridGenerateChunks(&jobs[i]);
+            ids[i] = pthread_self();
+        }
+    }
+    gridGenerateChunks(&jobs[0]);
+    for (int i = 0; i < threads; i++)
+    {
+        if (i > 0 && !pthread_equal(ids[i], pthread_self()))
+        {
+            pthread_join(ids[i], NULL);
+        }
+        failed |= jobs[i].failed;
+    }
+
+    free(jobs);
+    free(ids);
+    return failed ? -1 : 0;
+}
+
+/**
+ * Works out where each chunk goes, the chunks following each other from base
+ * (for compressed chunks this needs their sizes, from a GRID_PASS_SIZE pass)
+ * returns the offset just past the last chunk
+ */
+static inline uint64_t gridPlaceChunks(const GridFileHeader *header, GridChunk *chunks, uint64_t first_chunk, uint64_t end_chunk, uint64_t base)
+{
+    for (uint64_t c = first_chunk; c < end_chunk; c++)
+    {
+        chunks[c].offset = base;
+        if (header->codec == GRID_CODEC_NONE)
+        {
+            uint64_t rows = header->rows - c * header->chunk_rows < header->chunk_rows ? header->rows - c * header->chunk_rows : header->chunk_rows;
+            chunks[c].bytes = rows * header->columns * sizeof(double);
+        }
+        base += chunks[c].bytes;
+    }
+    return base;
+}
+
+/**
+ * Bytes before the first chunk: the header and index, or nothing for a raw file of bare doubles
+ */
+static inline uint64_t gridDataStart(const GridFileHeader *header, int raw)
+{
+    return raw ? 0 : sizeof(GridFileHeader) + header->chunk_count * sizeof(GridChunk);
+}
+
+/**
+ * Fills in the header's index checksum and writes the header and index at the start of a file
+ * returns 0 on success, -1 on a write error
+ */
+static inline int gridWriteIndex(int fd, GridFileHeader *header, const GridChunk *chunks)
+{
+    size_t index_bytes = (size_t)header->chunk_count * sizeof(GridChunk);
+    header->index_checksum = gridChecksum(chunks, index_bytes);
+    if (gridPwriteAll(fd, header, sizeof(GridFileHeader), 0) != 0)
+    {
+        return -1;
+    }
+    return gridPwriteAll(fd, chunks, index_bytes, sizeof(GridFileHeader));
+}
+
+/**
+ * Generates a whole grid file with the given number of threads, holding only a chunk per thread in memory at once
+ * compressed files take two passes, the first finding the size of every chunk so each thread knows where to write
+ * raw files are bare doubles with no header (and cannot be compressed)
+ * returns 0 on success, -1 on a write error
+ */
+static inline int gridGenerateFile(const char *path, int generator, uint64_t seed, uint64_t dimension, uint32_t codec, int raw, int threads)
+{
+    GridFileHeader header;
+    gridInitHeader(&header, dimension, dimension, gridDefaultChunkRows(dimension), raw ? GRID_CODEC_NONE : codec);
+    GridChunk *chunks = calloc(header.chunk_count, sizeof(GridChunk));
+
+    GridGeneratorJob settings = {0};
+    settings.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    settings.header = &header;
+    settings.chunks = chunks;
+    settings.generator = generator;
+    settings.seed = seed;
+    if (settings.fd < 0)
+    {
+        free(chunks);
+        return -1;
+    }
+
+    int failed = 0;
+    if (header.codec != GRID_CODEC_NONE)
+    {
+        failed |= gridRunPass(&settings, 0, header.chunk_count, GRID_PASS_SIZE, threads);
+    }
+    gridPlaceChunks(&header, chunks, 0, header.chunk_count, gridDataStart(&header, raw));
+    failed |= gridRunPass(&settings, 0, header.chunk_count, GRID_PASS_WRITE, threads);
+    if (!raw)
+    {
+        failed |= gridWriteIndex(settings.fd, &header, chunks);
+    }
+    failed |= close(settings.fd) != 0;
+
+    free(chunks);
+    return failed ? -1 : 0;
+}
+
+#endif
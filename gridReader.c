@@ -4,34 +4,94 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "gridFormat.h"
+
 // Program to read a grid from a file
 int main(int argc, char **argv)
 {
     int dimension = 12;
-    double **read = (double **)malloc(sizeof(double *) * dimension);
 
-    for (int l = 0; l < dimension; l++)
-    {
-        read[l] = (double *)malloc(sizeof(double) * dimension);
-    }
+    char default_file_name[50];
 
-    char *file_name = malloc(sizeof(char) * 50);
-
-    sprintf(file_name, "grids\\grid_%d.bin", dimension);
+    sprintf(default_file_name, "grids\\grid_%d.bin", dimension);
+    char *file_name = argc > 1 ? argv[1] : default_file_name;
     printf("File name: %s\n", file_name);
     FILE *in_file;
 
     in_file = fopen(file_name, "rb"); // r for read, b for binary
+    if (in_file == NULL)
+    {
+        printf("Unable to open %s\n", file_name);
+        return 1;
+    }
+
+    // files in the gridFormat.h format give their own dimension, raw files are assumed to be the default size
+    GridFileHeader header;
+    const char *error;
+    memset(&header, 0, sizeof(header));
+    fread(&header, sizeof(header), 1, in_file);
+    int format = gridCheckHeader(&header, &error);
+    if (format < 0)
+    {
+        printf("%s is a grid file with %s\n", file_name, error);
+        return 1;
+    }
+    if (format == 1)
+    {
+        double *row = (double *)malloc(sizeof(double) * dimension);
+        fseek(in_file, 0, SEEK_SET);
+        for (int x = 0; x < dimension; x++)
+        {
+            fread(row, sizeof(double) * dimension, 1, in_file);
+            for (int y = 0; y < dimension; y++)
+            {
+                printf("%f ", row[y]);
+            }
+            printf("\n");
+        }
+        fclose(in_file);
+        return 0;
+    }
+
+    printf("Dimension: %llu x %llu, %llu chunks of %llu rows, codec %u\n", (unsigned long long)header.rows,
+           (unsigned long long)header.columns, (unsigned long long)header.chunk_count, (unsigned long long)header.chunk_rows, header.codec);
+
+    GridChunk *chunks = malloc(sizeof(GridChunk) * header.chunk_count);
+    fread(chunks, sizeof(GridChunk), header.chunk_count, in_file);
+    if (gridChecksum(chunks, sizeof(GridChunk) * header.chunk_count) != header.index_checksum)
+    {
+        printf("The chunk index is corrupt\n");
+        return 1;
+    }
 
-    for (int x = 0; x < dimension; x++)
+    double *values = malloc(sizeof(double) * header.chunk_rows * header.columns);
+    unsigned char *stored = malloc(gridCompressBound(header.chunk_rows * header.columns));
+    for (uint64_t c = 0; c < header.chunk_count; c++)
     {
-        fread(read[x], sizeof(double)*dimension, 1, in_file);
-        for (int y = 0; y < dimension; y++)
+        uint64_t rows = header.rows - c * header.chunk_rows < header.chunk_rows ? header.rows - c * header.chunk_rows : header.chunk_rows;
+        size_t count = rows * header.columns;
+        fseek(in_file, (long)chunks[c].offset, SEEK_SET);
+        fread(stored, 1, chunks[c].bytes, in_file);
+
+        int corrupt = header.codec == GRID_CODEC_NONE ? (memcpy(values, stored, count * sizeof(double)), chunks[c].bytes != count * sizeof(double))
+                                                      : gridDecompress(stored, chunks[c].bytes, values, count) != 0;
+        if (corrupt || gridChecksum(values, count * sizeof(double)) != chunks[c].checksum)
+        {
+            printf("Chunk %llu is corrupt\n", (unsigned long long)c);
+            return 1;
+        }
+        for (size_t i = 0; i < count; i++)
         {
-            printf("%f ", read[x][y]);
+            printf("%f ", values[i]);
+            if ((i + 1) % header.columns == 0)
+            {
+                printf("\n");
+            }
         }
-        printf("\n");
     }
+    free(chunks);
+    free(values);
+    free(stored);
     fclose(in_file);
     return 0;
 }
\ No newline at end of file
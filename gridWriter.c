@@ -1,30 +1,133 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <unistd.h>
 
+#ifdef GRID_WRITER_MPI
+#include <mpi.h>
+#endif
+
+#include "gridGenerator.h"
+
+#ifdef GRID_WRITER_MPI
 /**
- * Fills the first row and left most columns of a 2d array with 1s
- **/
-int populateGrid(double **grid, int dimension)
+ * Generates a grid file as one MPI process of many, each process taking a run of the chunks and writing them at their offsets,
+ * and the first process writing the header and index
+ * returns 0 on success, -1 on a write error
+ */
+int generateFileMPI(char *file_name, int generator, uint64_t seed, int size, uint32_t codec, int raw, int threads)
 {
-    for (int i = 0; i < dimension; i++)
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+
+    GridFileHeader header;
+    gridInitHeader(&header, size, size, gridDefaultChunkRows(size), raw ? GRID_CODEC_NONE : codec);
+    GridChunk *chunks = calloc(header.chunk_count, sizeof(GridChunk));
+    uint64_t first_chunk = header.chunk_count * rank / processes;
+    uint64_t end_chunk = header.chunk_count * (rank + 1) / processes;
+
+    // the first process creates (and empties) the file before anyone writes to it
+    int fd = -1;
+    if (rank == 0)
+    {
+        fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank != 0)
+    {
+        fd = open(file_name, O_WRONLY);
+    }
+
+    GridGeneratorJob settings = {0};
+    settings.fd = fd;
+    settings.header = &header;
+    settings.chunks = chunks;
+    settings.generator = generator;
+    settings.seed = seed;
+
+    int failed = fd < 0;
+    if (header.codec != GRID_CODEC_NONE && !failed)
+    {
+        failed |= gridRunPass(&settings, first_chunk, end_chunk, GRID_PASS_SIZE, threads);
+    }
+
+    // each process's chunks follow those of the processes before it
+    // (without compression every chunk but the last is the same size, so the offsets are known up front)
+    unsigned long long before = 0;
+    if (header.codec == GRID_CODEC_NONE)
+    {
+        before = first_chunk * header.chunk_rows * header.columns * sizeof(double);
+    }
+    else
+    {
+        unsigned long long bytes = 0;
+        for (uint64_t c = first_chunk; c < end_chunk; c++)
+        {
+            bytes += chunks[c].bytes;
+        }
+        MPI_Exscan(&bytes, &before, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+        before = rank == 0 ? 0 : before;
+    }
+    gridPlaceChunks(&header, chunks, first_chunk, end_chunk, gridDataStart(&header, raw) + before);
+    if (!failed)
+    {
+        failed |= gridRunPass(&settings, first_chunk, end_chunk, GRID_PASS_WRITE, threads);
+    }
+
+    // gather the index onto the first process, which writes it with the header
+    int *counts = malloc(sizeof(int) * processes);
+    int *displacements = malloc(sizeof(int) * processes);
+    for (int i = 0; i < processes; i++)
+    {
+        uint64_t first = header.chunk_count * i / processes;
+        counts[i] = (int)((header.chunk_count * (i + 1) / processes - first) * sizeof(GridChunk));
+        displacements[i] = (int)(first * sizeof(GridChunk));
+    }
+    MPI_Gatherv(rank == 0 ? MPI_IN_PLACE : &chunks[first_chunk], counts[rank], MPI_BYTE, chunks, counts, displacements, MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (rank == 0 && !raw && !failed)
     {
-        grid[i][0] = 1;
-        grid[0][i] = 1;
+        failed |= gridWriteIndex(fd, &header, chunks);
     }
-    return 0;
+    if (fd >= 0)
+    {
+        failed |= close(fd) != 0;
+    }
+
+    int any_failed;
+    MPI_Allreduce(&failed, &any_failed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+
+    free(counts);
+    free(displacements);
+    free(chunks);
+    return any_failed ? -1 : 0;
 }
+#endif
 
 // Program to write a grid of random 1s and 0s to a file
+// the grid is generated and written a chunk at a time by each thread (and, built with -DGRID_WRITER_MPI, by each process),
+// so it never needs to fit in memory, and comes out the same for the same seed however many writers there are
 int main(int argc, char **argv)
 {
+#ifdef GRID_WRITER_MPI
+    MPI_Init(&argc, &argv);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#else
+    int rank = 0;
+#endif
+
     // size defaults to 10 if there are not arguments
     int size = 10;
     int opt;
-    int basic = 0;
+    int generator = GRID_GENERATOR_RANDOM;
+    const char *generator_name = "random";
+    int raw = 0;                      // by default, write the self describing format of gridFormat.h rather than bare doubles
+    uint32_t codec = GRID_CODEC_NONE; // and leave the chunks uncompressed
+    uint64_t seed = 0;                // the same seed always gives the same grid
+    int threads = 1;
+    char *file_name = NULL;
     // Handle the arguement(s)
-    while ((opt = getopt(argc, argv, "bs:")) != -1)
+    while ((opt = getopt(argc, argv, "bg:s:rzS:n:o:")) != -1)
     {
         switch (opt)
         {
@@ -32,58 +135,62 @@ int main(int argc, char **argv)
             size = atoi(optarg); // the dimensions of the grid
             break;
         case 'b':
-            basic = 1;
+            generator = GRID_GENERATOR_SIMPLE;
+            generator_name = "basic";
+            break;
+        case 'g':
+            if (gridParseGenerator(optarg, &generator, &seed) != 0)
+            {
+                printf("-g must be one of simple, random[:<seed>], sine or linear\n");
+                return 1;
+            }
+            generator_name = optarg;
+            break;
+        case 'r':
+            raw = 1;
+            break;
+        case 'z':
+            codec = GRID_CODEC_XOR_RUNS;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'n':
+            threads = atoi(optarg); // writer threads (per process)
+            break;
+        case 'o':
+            file_name = optarg;
             break;
         default:
             break;
         }
     }
-    printf("Size: %d\n", size);
-
-    // Allocate memory for the grid
-    double **grid = (double **)malloc(sizeof(double *) * size);
-    int l;
-    for (l = 0; l < size; l++)
+    if (threads < 1)
     {
-        grid[l] = (double *)malloc(sizeof(double) * size);
+        threads = 1;
     }
 
-    if (basic)
+    if (file_name == NULL)
     {
-        printf("basic\n");
-        populateGrid(grid, size);
+        file_name = malloc(sizeof(char) * 50);
+        sprintf(file_name, "grids\\grid_%d.bin", size);
     }
-    else
+    if (rank == 0)
     {
-        // Generate the grid
-        srand(time(NULL));
-
-        for (int x = 0; x < size; x++)
-        {
-            for (int y = 0; y < size; y++)
-            {
-                grid[x][y] = (double)(rand() % 2);
-                printf("%f ", grid[x][y]);
-            }
-            printf("\n");
-        }
+        printf("Size: %d\n", size);
+        printf("%s, seed %llu\n", generator_name, (unsigned long long)seed);
+        printf("File name: %s\n", file_name);
     }
-    // Write to file
-
-    FILE *write_ptr;
-
-    char *file_name = malloc(sizeof(char) * 50);
 
-    sprintf(file_name, "grids\\grid_%d.bin", size);
-    printf("File name: %s\n", file_name);
-    write_ptr = fopen(file_name, "wb");
-
-    for (int x = 0; x < size; x++)
+#ifdef GRID_WRITER_MPI
+    int failed = generateFileMPI(file_name, generator, seed, size, codec, raw, threads);
+    MPI_Finalize();
+#else
+    int failed = gridGenerateFile(file_name, generator, seed, size, codec, raw, threads);
+#endif
+    if (failed && rank == 0)
     {
-        fwrite(grid[x], sizeof(double) * size, 1, write_ptr);
+        printf("Unable to write %s\n", file_name);
     }
-
-    fclose(write_ptr);
-
-    return 0;
+    return failed ? 1 : 0;
 }
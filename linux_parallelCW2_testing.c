@@ -4,9 +4,40 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <float.h>
+#include <signal.h>
+#include <limits.h>
+
+#include "gridGenerator.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
 
 #define SEND_TOP_EDGE_TAG 0
 #define SEND_BOTTOM_EDGE_TAG 1
+#define SEND_LEFT_EDGE_TAG 2
+#define SEND_RIGHT_EDGE_TAG 3
+
+// alignment (in bytes) of each grid allocation and of the start of every row within it
+#define GRID_ALIGNMENT 64
+
+// pointer to the first value of a row in a grid, negative rows (and rows past the end) address the ghost rows
+#define GRID_ROW(grid, row) ((grid)->data + (ptrdiff_t)(row) * (ptrdiff_t)(grid)->stride)
+
+// size of a cache line, used to keep values written by different threads on separate lines
+#define CACHE_LINE_BYTES 64
+
+// number of times the interior sweep stops to let MPI progress the halo exchange
+#define PROGRESS_POLLS 8
+
+// bytes of cache each column tile of a temporal block is sized to fit in (override at compile time to match the target's L2)
+#ifndef TILE_CACHE_BYTES
+#define TILE_CACHE_BYTES (256 * 1024)
+#endif
 
 // used to check that MPI functions have executed correctly
 #define MPI_CHECK(fn)                   \
@@ -17,15 +48,395 @@
             handle_error(errcode, #fn); \
     }
 
-double **readGrid(char *file_name, int dimension, int allocStart, int allocRows, int rank);
-double relaxCell(double **grid, int row, int column);
-double **relaxGrid(double **in_grid, double **out_grid, int start_rows, int rows, int columns);
-double *relaxEdge(double *in_edge, double *neighbours_above, double *neighbours_below, double *out_edge, int columns);
-int checkComplete(double **grid, double **newGrid, int rows, int columns, double precision);
-double **allocateGridMem(int rows, int columns);
-double **copyEdges(double **from_grid, double **to_grid, int allocRows, int dimension, int rank, int size);
-int swapGrids(double **fromGrid, double **toGrid, int rows);
-void writeGrid(double **grid, char *file_name, int dimension, int allocStart, int allocRows);
+/**
+ * A process's portion of the overall grid, held in a single aligned allocation
+ * rows are padded out to stride values so that every row starts on a GRID_ALIGNMENT boundary
+ */
+typedef struct
+{
+    double *data; // the process's first value, ghost rows (and columns) sit immediately around the process's values
+    double *base; // start of the allocation, including the ghost rows above
+    int rows;
+    int columns;
+    int stride;      // distance, in doubles, between the start of consecutive rows
+    int halo;        // number of ghost rows held above and below the process's rows
+    int column_halo; // number of ghost columns held either side of the process's columns
+} Grid;
+
+/**
+ * Where a process's block sits in the overall grid
+ */
+typedef struct
+{
+    int row_start;
+    int rows;
+    int column_start;
+    int columns;
+} GridLayout;
+
+/**
+ * The ways processes can agree on whether the relaxation is complete
+ * the largest change made by an iteration never grows, so checking late never gives a result outside the precision
+ */
+typedef enum
+{
+    CHECK_EVERY,     // blocking reduction every interval iterations
+    CHECK_ADAPTIVE,  // blocking reduction at intervals estimated from how quickly the largest change is shrinking
+    CHECK_OVERLAPPED // non-blocking reduction every iteration, completed while the next iteration is computed
+} CheckMode;
+
+// results of checkConvergence
+#define CHECK_CONTINUE 0
+#define CHECK_FINISHED 1
+#define CHECK_FINISHED_PREVIOUS 2 // the iteration before the latest was already complete
+
+/**
+ * State of the convergence check policy, set up by parseConvergenceCheck
+ */
+typedef struct
+{
+    CheckMode mode;
+    int interval;      // iterations between checks, or the longest interval allowed for CHECK_ADAPTIVE
+    int next_check;    // iteration at which the next blocking check is due
+    int last_check;    // iteration of the previous blocking check
+    double last_delta; // overall largest change found by the previous blocking check
+    double send_delta; // buffers for the reduction in flight with CHECK_OVERLAPPED
+    double recv_delta;
+    MPI_Request request;
+    int pending;
+} ConvergenceCheck;
+
+/**
+ * A thread's largest change, padded out to a whole cache line so threads never write to the same line
+ */
+typedef struct
+{
+    double value;
+    char padding[CACHE_LINE_BYTES - sizeof(double)];
+} PaddedDelta;
+
+struct workerPool;
+
+/**
+ * Arguements passed to each worker thread of a pool
+ */
+typedef struct
+{
+    struct workerPool *pool;
+    int index;
+} WorkerArgs;
+
+/**
+ * Persistent threads that share out the rows of relaxations within a process, for running fewer processes per node
+ * the main thread takes part in every job, so a pool of thread_count threads starts thread_count - 1 workers
+ */
+typedef struct workerPool
+{
+    int thread_count;
+    pthread_t *threads;
+    WorkerArgs *args;
+    pthread_barrier_t start; // workers wait here for a job (or for shutdown)
+    pthread_barrier_t done;  // and here once their share of it is complete
+    int shutdown;
+    PaddedDelta *deltas; // each thread's largest change in the current job
+
+    // the region being relaxed by the current job, as passed to relaxRegion
+    Grid *in_grid;
+    Grid *out_grid;
+    int row_start, row_end;
+    int column_start, column_end;
+    const int *bounds;
+} WorkerPool;
+
+// positions of each request in a RowHalo set
+#define HALO_RECV_TOP 0
+#define HALO_RECV_BOTTOM 1
+#define HALO_SEND_TOP 2
+#define HALO_SEND_BOTTOM 3
+
+/**
+ * Persistent requests for the single row halo exchange, set up once by initRowHalo
+ */
+typedef struct
+{
+    MPI_Request requests[2][4]; // a set of requests for each of the two grids
+    double *slabs[2];           // the storage of each grid, to pick the set for the grid being relaxed from
+    int partitions;             // partitions per row with MPI-4 partitioned communication, 0 if not used
+} RowHalo;
+
+/**
+ * The iterative methods the grid can be relaxed with
+ */
+typedef enum
+{
+    METHOD_JACOBI,   // every value relaxed from the previous iteration's values, into a second grid
+    METHOD_RED_BLACK, // red-black Gauss-Seidel (or SOR), relaxing alternate cells in place
+    METHOD_MULTIGRID, // multigrid V-cycles, smoothed with weighted Jacobi
+    METHOD_CG         // (preconditioned) conjugate gradients
+} Method;
+
+/**
+ * Preconditioners for METHOD_CG
+ */
+typedef enum
+{
+    PRECONDITIONER_NONE,
+    PRECONDITIONER_JACOBI,      // the diagonal of the Laplacian
+    PRECONDITIONER_BLOCK_JACOBI // each process's block of rows, ignoring the others
+} Preconditioner;
+
+// multigrid levels stop coarsening at this dimension (3 x 3 values away from the fixed edges)
+#define MULTIGRID_COARSEST_DIMENSION 5
+
+// fewest rows a process may hold of a level split between processes, before the level is gathered onto one process instead
+#define MULTIGRID_MIN_ROWS 4
+
+#define MULTIGRID_MAX_LEVELS 32
+
+// weighted Jacobi sweeps before and after each coarse correction, and the weight that best damps oscillating errors in 2D
+#define MULTIGRID_SMOOTHING_SWEEPS 2
+#define MULTIGRID_WEIGHT 0.8
+
+// V-cycles run on the gathered coarsest level as its solve
+#define MULTIGRID_COARSE_CYCLES 2
+
+// weighted Jacobi sweeps that solve a coarsest level held by one process (at most 3 x 3 values away from the fixed edges)
+#define MULTIGRID_COARSEST_SWEEPS 32
+
+/**
+ * One level of a multigrid hierarchy, split between processes by rows
+ */
+typedef struct
+{
+    int dimension; // values per row and column, including the fixed edges
+    int row_start; // overall index of the process's first row of the level
+    // spacing between the last row (and column) before the far edges and those edges, as a fraction of the level's spacing,
+    // which is below 1 on coarse levels of a dimension where dimension - 1 is odd, as the far edge never moves
+    double edge_fraction;
+    Grid u;        // the solution on the finest level, and the correction to the level above on the others
+    Grid f;        // right hand side, scaled by the square of the level's spacing
+    Grid r;        // residual, f - Au
+    Grid scratch;  // averages of each value's neighbours in u
+    MPI_Request u_halo[4];
+    MPI_Request r_halo[4];
+} MultigridLevel;
+
+/**
+ * A multigrid hierarchy, finest level first
+ */
+typedef struct multigrid
+{
+    MPI_Comm comm;
+    int rank, size;
+    int depth;
+    MultigridLevel *levels;
+
+    // when split between processes, the coarsest level is gathered onto the first process and solved by its own hierarchy
+    struct multigrid *gathered; // NULL except on the first process
+    MPI_Datatype block_type;    // the process's rows of the coarsest level
+    double *gather_buffer;
+    int *counts, *displacements;
+} Multigrid;
+
+// single precision units of the grid's largest value that a change must fall to before mixed precision switches to double
+// (single precision iterations stall a few units above its resolution)
+#define MIXED_SWITCH_ULPS 64
+
+// iterations between the checks for single precision having stalled, which switch to double once the largest change
+// stops falling (Jacobi's largest change never grows in exact arithmetic, so only rounding can stop it falling)
+#define MIXED_STALL_WINDOW 64
+
+/**
+ * A process's rows of the grid in single precision, with a ghost row above and below, laid out like Grid
+ */
+typedef struct
+{
+    float *data;
+    float *base;
+    int rows;
+    int columns;
+    int stride;
+} FloatGrid;
+
+// checkpoint files start with a CheckpointHeader and hold the overall grid, row-major, from this offset
+#define CHECKPOINT_MAGIC "LAPCKPT"
+#define CHECKPOINT_DATA_OFFSET 4096
+
+// iterations a checkpoint is left writing in the background before it is waited on and marked complete
+#define CHECKPOINT_DRAIN_ITERATIONS 16
+
+// iterations between checks for SIGTERM, which need a reduction so that every process stops at the same iteration
+#define CHECKPOINT_SIGNAL_POLL 16
+
+/**
+ * Header at the start of a checkpoint file
+ */
+typedef struct
+{
+    char magic[8]; // CHECKPOINT_MAGIC
+    int64_t dimension;
+    int64_t iterations; // iterations done when the checkpoint was taken, 0 while it is still being written
+    int64_t processes;  // number of processes that wrote it, which need not match the number that restart from it
+} CheckpointHeader;
+
+/**
+ * State of the periodic checkpoints of a relaxation
+ * checkpoints alternate between <name>.0 and <name>.1, so the previous one stays complete while the next is written
+ */
+typedef struct
+{
+    char *file_names[2];
+    int next_file; // which of the files the next checkpoint goes to
+    int interval;  // iterations between checkpoints
+    int dimension;
+    GridLayout layout;
+    Grid staging;    // copy of the process's values being written, so relaxation can carry on overwriting the grid
+    MPI_File handle; // the file being written, MPI_FILE_NULL when no checkpoint is in progress
+    MPI_Request request;
+    int iterations; // held by the checkpoint being written
+    int due;        // iteration at which it is completed
+} Checkpoint;
+
+// side of the snapshots taken with -S, unless another size is given
+#define SNAPSHOT_DEFAULT_SIZE 1024
+
+/**
+ * State of the snapshots of a relaxation, each the overall grid downsampled to size x size values by block averaging
+ * every process sums its values into the snapshot values its block covers, and the first process gathers and assembles them
+ */
+typedef struct
+{
+    int interval; // iterations between snapshots
+    int size;
+    int dimension;
+    GridLayout layout;
+    GridLayout covered; // the snapshot values the process's block contributes to
+    int *column_map;    // covered column of each of the process's columns
+    double *sums;
+    // on the first process only
+    int *counts;        // values gathered from each process
+    int *displacements; // where each process's values start in gathered
+    GridLayout *blocks; // the snapshot values each process's values cover
+    double *gathered;
+    double *snapshot;
+} Snapshot;
+
+/**
+ * Settings given on the command line, shared by every way of splitting the grid between processes
+ */
+typedef struct
+{
+    int dimension;
+    double precision;
+    char *file_name;
+    int generator;  // GRID_GENERATOR_* to build the grid in memory, or -1 to read it from file_name
+    uint64_t seed;  // for GRID_GENERATOR_RANDOM
+    int halo_depth;
+    int partitions; // partitions per halo row with MPI-4 partitioned communication, 0 for plain persistent requests
+    Method method;
+    double omega; // over-relaxation factor for METHOD_RED_BLACK, 0 to estimate the best for the dimension
+    Preconditioner preconditioner;
+    int mixed_precision; // relax in single precision until close to the precision, then finish in double
+    ConvergenceCheck check;
+    char *checkpoint_name;   // checkpoints go to <checkpoint_name>.0 and .1
+    int checkpoint_interval; // iterations between checkpoints, 0 for none
+    char *restart_file;      // checkpoint to start from instead of the grid, NULL to start from the grid
+    int restart_iterations;  // iterations already done by the checkpoint
+    int restart_index;       // which of the two checkpoint files it is
+    int interrupted;         // set when the relaxation stopped early on SIGTERM, leaving a final checkpoint
+    int snapshot_interval;   // iterations between snapshots, 0 for none
+    int snapshot_size;
+} SolverOptions;
+
+/**
+ * Relaxes the interior values (1 to columns - 2) of a single row, given the rows either side of it
+ * returns the largest absolute change made to any value, so convergence is found in the same pass
+ * every variant sums the neighbours in the same order so they all produce bit-identical results
+ */
+typedef double (*RowKernel)(const double *restrict above, const double *restrict row, const double *restrict below,
+                          double *restrict out, int columns);
+
+/**
+ * Single precision version of RowKernel, used for the sweeps of mixed precision relaxation
+ */
+typedef float (*FloatRowKernel)(const float *restrict above, const float *restrict row, const float *restrict below,
+                                float *restrict out, int columns);
+
+Grid loadGrid(SolverOptions *options, GridLayout *layout, int halo, int column_halo);
+Grid readGrid(char *file_name, int dimension, GridLayout *layout, int halo, int column_halo);
+int readGridHeader(MPI_File handle, char *file_name, GridFileHeader *header);
+int readGridDimension(char *file_name);
+void readAtAll(MPI_File handle, MPI_Offset offset, unsigned char *buffer, size_t bytes);
+void readGridChunks(MPI_File handle, char *file_name, GridFileHeader *header, Grid *grid, GridLayout *layout);
+void readBlock(MPI_File handle, MPI_Offset displacement, Grid *grid, int dimension, GridLayout *layout);
+void createBlockTypes(Grid *grid, int dimension, GridLayout *layout, MPI_Datatype *file_type, MPI_Datatype *memory_type);
+void calculateAllocation(int total, int parts, int index, int *start, int *count);
+int relaxRowBlocks(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size);
+int relaxCartesian(SolverOptions *options, Grid *result, GridLayout *layout);
+double relaxRegion(Grid *in_grid, Grid *out_grid, int row_start, int row_end, int column_start, int column_end, const int bounds[4]);
+double relaxRegionParallel(Grid *in_grid, Grid *out_grid, int row_start, int row_end, int column_start, int column_end, const int bounds[4]);
+WorkerPool *createWorkerPool(int thread_count);
+void destroyWorkerPool(WorkerPool *pool);
+void *poolWorker(void *dummyArgs);
+double relaxPoolShare(WorkerPool *pool, int index);
+int threadsPerProcess(void);
+double relaxRowScalar(const double *restrict above, const double *restrict row, const double *restrict below,
+                      double *restrict out, int columns);
+float relaxRowFloatScalar(const float *restrict above, const float *restrict row, const float *restrict below,
+                          float *restrict out, int columns);
+RowKernel selectRowKernel(const char *name, const char **selected_name, FloatRowKernel *float_kernel);
+double relaxGrid(Grid *in_grid, Grid *out_grid, int start_row, int rows);
+double relaxEdge(double *in_edge, double *neighbours_above, double *neighbours_below, double *out_edge, int columns);
+void exchangeHalo(Grid *in_grid, Grid *out_grid, int depth, int rank, int size);
+void initRowHalo(RowHalo *halo, Grid *in_grid, Grid *out_grid, double *top_edge_neighbours, double *bottom_edge_neighbours,
+                 int partitions, int rank, int size);
+MPI_Request *startRowHalo(RowHalo *halo, Grid *in_grid);
+void freeRowHalo(RowHalo *halo);
+double relaxTemporalBlock(Grid *in_grid, Grid *out_grid, int depth, int has_top, int has_bottom);
+int relaxTemporalBlocking(Grid *in_grid, Grid *out_grid, int depth, double precision, ConvergenceCheck *check, int rank, int size);
+int parseConvergenceCheck(const char *arg, ConvergenceCheck *check);
+int checkConvergence(ConvergenceCheck *check, double max_delta, int iterations, double precision);
+void abandonConvergenceCheck(ConvergenceCheck *check);
+Grid allocateGridMem(int rows, int columns, int halo, int column_halo);
+void freeGridMem(Grid *grid);
+Grid *copyEdges(Grid *from_grid, Grid *to_grid, int rank, int size);
+int swapGrids(Grid *fromGrid, Grid *toGrid);
+void writeGrid(Grid *grid, char *file_name, int dimension, GridLayout *layout);
+int parseIoHints(char *arg, MPI_Info *info);
+int parseMethod(const char *arg, SolverOptions *options);
+double optimalOmega(int dimension);
+void initGhostRowExchange(Grid *grid, MPI_Request requests[4], MPI_Comm comm, int rank, int size);
+double relaxColour(Grid *grid, int row_start, int row_end, int first_row_global, int colour, double omega);
+int relaxRedBlack(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size);
+void clearGrid(Grid *grid);
+Multigrid *createMultigrid(Grid *finest, int dimension, double edge_fraction, int row_start, int rows, MPI_Comm comm);
+void destroyMultigrid(Multigrid *multigrid);
+void smoothLevel(MultigridLevel *level, int sweeps);
+double computeResidual(MultigridLevel *level);
+void restrictResidual(MultigridLevel *fine, MultigridLevel *coarse);
+void prolongCorrection(MultigridLevel *coarse, MultigridLevel *fine);
+void solveCoarsest(Multigrid *multigrid);
+void vCycle(Multigrid *multigrid, int index);
+int relaxMultigrid(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size);
+double dotProduct(Grid *a, Grid *b, int first_row, int end_row);
+void applyLaplacian(Grid *x_grid, Grid *out, Grid *scratch, int first_row, int end_row, int subtract);
+void precondition(Preconditioner preconditioner, Grid *r, Grid *z, int first_row, int end_row);
+int relaxConjugateGradient(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size);
+void initRowExchange(void *first_row, void *last_row, void *ghost_above, void *ghost_below, int count, MPI_Datatype type,
+                     MPI_Request requests[4], MPI_Comm comm, int rank, int size);
+FloatGrid allocateFloatGridMem(int rows, int columns);
+int relaxSinglePrecision(Grid *grid, ConvergenceCheck check, double precision, int rank, int size);
+int parseCheckpoint(const char *arg, SolverOptions *options);
+int findCheckpoint(char *name, int dimension, int *index, int *processes);
+void initCheckpoint(Checkpoint *checkpoint, SolverOptions *options, GridLayout *layout);
+void startCheckpoint(Checkpoint *checkpoint, Grid *grid, int iterations);
+void finishCheckpoint(Checkpoint *checkpoint);
+int updateCheckpoint(Checkpoint *checkpoint, Grid *grid, int iterations);
+void freeCheckpoint(Checkpoint *checkpoint);
+int parseSnapshot(const char *arg, SolverOptions *options);
+void initSnapshot(Snapshot *snapshot, SolverOptions *options, GridLayout *layout);
+void takeSnapshot(Snapshot *snapshot, Grid *grid, int iterations);
+void freeSnapshot(Snapshot *snapshot);
 
 /**
  * Function that outputs to handle errors in MPI functions
@@ -39,415 +450,3363 @@ static void handle_error(int errcode, char *str)
     MPI_Abort(MPI_COMM_WORLD, 1);
 }
 
+// the row kernel used by relaxGrid and relaxEdge, chosen at startup by selectRowKernel
+static RowKernel relaxRow = relaxRowScalar;
+
+// the single precision kernel matching relaxRow, used by relaxSinglePrecision
+static FloatRowKernel relaxRowFloat = relaxRowFloatScalar;
+
+// threads sharing each process's relaxation, NULL when each process relaxes on its main thread alone
+static WorkerPool *workerPool = NULL;
+
+// hints given with -i, passed to MPI-IO whenever a grid file is opened
+static MPI_Info ioHints = MPI_INFO_NULL;
+
+// set by the SIGTERM handler (installed with -C), so a final checkpoint can be written before the job is killed
+static volatile sig_atomic_t terminationRequested = 0;
+
+static void handleTerminate(int signum)
+{
+    (void)signum;
+    terminationRequested = 1;
+}
+
 int main(int argc, char **argv)
 {
-    int size, rank;
-    MPI_Init(&argc, &argv);
+    int size, rank, provided;
+    // worker threads never call MPI, so only the main thread needs to be able to
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    // Handle Arguements
-    int opt;
-    int dimension = -1;          // dimension is required so initialise to -1 (invalid value) to check later
-    double precision = 0.01;        // set default for precision
-    int write_to_file = 0;       // by default, don't write the final grid to a file
-    int performance_testing = 0; // by default, don't write performance data to a file
+    // Handle Arguements
+    int opt;
+    SolverOptions options;
+    options.dimension = -1;       // dimension is required so initialise to -1 (invalid value) to check later
+    options.precision = 0.01;     // set default for precision
+    options.file_name = NULL;
+    options.generator = -1;       // by default, read the grid from a file
+    options.seed = 0;
+    options.halo_depth = 1;       // by default, exchange one ghost row and relax once per exchange
+    options.partitions = 0;       // by default, exchange halos with plain persistent requests
+    parseConvergenceCheck("every:1", &options.check); // by default, check for completion after every iteration
+    parseMethod("jacobi", &options);                  // by default, relax with Jacobi iteration
+    options.mixed_precision = 0;                      // by default, relax in double precision throughout
+    options.checkpoint_name = NULL;                   // by default, checkpoints are named after the dimension
+    options.checkpoint_interval = 0;                  // by default, don't checkpoint
+    options.restart_file = NULL;
+    options.restart_iterations = 0;
+    options.restart_index = 1;
+    options.interrupted = 0;
+    options.snapshot_interval = 0;                    // by default, don't take snapshots
+    int restart = 0; // by default, start from the grid rather than a checkpoint
+
+    int write_to_file = 0;       // by default, don't write the final grid to a file
+    int performance_testing = 0; // by default, don't write performance data to a file
+    int cartesian = 0;           // by default, split the grid between processes by rows only
+    int threads = 1;             // by default, each process relaxes on a single thread
+
+    char *kernel_name = NULL; // by default, pick the widest row kernel the CPU supports
+    char *performance_out = NULL;
+
+    while ((opt = getopt(argc, argv, "t:wd:p:f:g:k:b:c:2n:P:s:mi:C:rS:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            options.dimension = atoi(optarg);
+            break;
+        case 'f':
+            options.file_name = optarg;
+            break;
+        case 'g':
+            if (gridParseGenerator(optarg, &options.generator, &options.seed) != 0)
+            {
+                printf("-g must be one of simple, random[:<seed>], sine or linear\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            break;
+        case 'p':
+            options.precision = atof(optarg);
+            break;
+        case 'w':
+            write_to_file = 1;
+            break;
+        case 'k':
+            kernel_name = optarg;
+            break;
+        case 'b':
+            options.halo_depth = atoi(optarg);
+            break;
+        case 'c':
+            if (parseConvergenceCheck(optarg, &options.check) != 0)
+            {
+                printf("-c must be one of every:<iterations>, adaptive[:<max iterations>] or overlap\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            break;
+        case '2':
+            cartesian = 1;
+            break;
+        case 'i':
+            if (parseIoHints(optarg, &ioHints) != 0)
+            {
+                printf("-i must be a comma separated list of MPI-IO hints, e.g. cb_nodes=8,cb_buffer_size=16777216,striping_factor=16\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            break;
+        case 'm':
+            options.mixed_precision = 1;
+            break;
+        case 'C':
+            if (parseCheckpoint(optarg, &options) != 0)
+            {
+                printf("-C must be <iterations>[:<file name>], a positive number of iterations between checkpoints\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            break;
+        case 'r':
+            restart = 1;
+            break;
+        case 'S':
+            if (parseSnapshot(optarg, &options) != 0)
+            {
+                printf("-S must be <iterations>[:<size>], a positive number of iterations between snapshots of at most size x size values\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            break;
+        case 's':
+            if (parseMethod(optarg, &options) != 0)
+            {
+                printf("-s must be one of jacobi, gs, sor[:<omega between 0 and 2>] multigrid or cg[:none|jacobi|block]\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            break;
+        case 'P':
+            options.partitions = atoi(optarg);
+            break;
+        case 'n':
+            threads = strcmp(optarg, "auto") == 0 ? threadsPerProcess() : atoi(optarg);
+            break;
+        case 't':
+            performance_testing = 1;
+            performance_out = optarg;
+        default:
+            break;
+        }
+    }
+
+    // Check arguements:
+    // grid files in the container format record their dimension, so -d can be left out for them
+    if (options.dimension == -1 && options.file_name != NULL)
+    {
+        options.dimension = readGridDimension(options.file_name);
+    }
+    if (options.dimension == -1)
+    {
+        printf("-d is mandatory, unless -f gives a grid file that records its dimension!\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.generator >= 0 && options.file_name != NULL)
+    {
+        printf("-f and -g cannot be used together, the grid is either read or generated\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (cartesian && options.halo_depth != 1)
+    {
+        printf("-b is only supported when splitting by rows, not with -2\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.method != METHOD_JACOBI && (cartesian || options.halo_depth != 1))
+    {
+        printf("-s gs, sor, multigrid and cg are only supported when splitting by rows, without -2 or -b\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.mixed_precision && (options.method != METHOD_JACOBI || cartesian))
+    {
+        printf("-m is only supported for Jacobi iteration when splitting by rows, not with -2 or -s\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.checkpoint_interval > 0 && (options.method != METHOD_JACOBI || options.halo_depth != 1 || options.mixed_precision))
+    {
+        printf("-C is only supported for double precision Jacobi iteration with a single row halo, not with -b, -m or -s\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (restart && options.method != METHOD_JACOBI)
+    {
+        // the other methods would read the checkpoint's grid, but count their iterations from 0
+        printf("-r is only supported for Jacobi iteration, not with -s\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.snapshot_interval > 0 && (options.method != METHOD_JACOBI || options.halo_depth != 1 || options.mixed_precision))
+    {
+        printf("-S is only supported for double precision Jacobi iteration with a single row halo, not with -b, -m or -s\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#if MPI_VERSION >= 4
+    if (options.partitions < 0 || (options.partitions > 0 && options.dimension % options.partitions != 0))
+    {
+        printf("-P must be a number of partitions that divides the dimension\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.partitions > 0 && (cartesian || options.halo_depth != 1))
+    {
+        printf("-P is only supported for the single row halo exchange when splitting by rows\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#else
+    if (options.partitions != 0)
+    {
+        printf("-P needs an MPI-4 library for partitioned communication\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#endif
+
+    const char *selected_kernel;
+    relaxRow = selectRowKernel(kernel_name, &selected_kernel, &relaxRowFloat);
+    if (relaxRow == NULL)
+    {
+        printf("-k %s is not a kernel supported by this CPU (scalar, sse2, avx2, avx512)\n", kernel_name);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (rank == 0)
+    {
+        printf("Using %s row kernel\n", selected_kernel);
+    }
+
+    if (threads < 1)
+    {
+        printf("-n must be a positive number of threads, or auto\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (threads > 1)
+    {
+        if (provided < MPI_THREAD_FUNNELED)
+        {
+            printf("-n needs an MPI library supporting MPI_THREAD_FUNNELED\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        workerPool = createWorkerPool(threads);
+        if (rank == 0)
+        {
+            printf("Using %d threads per process\n", threads);
+        }
+    }
+
+    char *file_name = NULL;
+    if (options.file_name == NULL && options.generator < 0)
+    {
+        file_name = malloc(sizeof(char) * 50);
+
+        sprintf(file_name, "grids/grid_%d.bin", options.dimension);
+        options.file_name = file_name;
+    }
+
+    // setup the file name to write the final grid to
+    char *out_file_name = malloc(sizeof(char) * 50);
+    sprintf(out_file_name, "grids/grid_%d_out.bin", options.dimension);
+
+    char *checkpoint_name = NULL;
+    if (options.checkpoint_name == NULL)
+    {
+        checkpoint_name = malloc(sizeof(char) * 50);
+        sprintf(checkpoint_name, "grids/checkpoint_%d", options.dimension);
+        options.checkpoint_name = checkpoint_name;
+    }
+
+    // carry on from the latest complete checkpoint, if there is one
+    // it holds the whole grid, so each process reads its own block of it whatever number of processes (and split) wrote it
+    char *restart_file = NULL;
+    int restart_processes = 0;
+    if (restart)
+    {
+        options.restart_iterations = findCheckpoint(options.checkpoint_name, options.dimension, &options.restart_index, &restart_processes);
+        if (options.restart_iterations > 0)
+        {
+            restart_file = malloc(strlen(options.checkpoint_name) + 3);
+            sprintf(restart_file, "%s.%d", options.checkpoint_name, options.restart_index);
+            options.restart_file = restart_file;
+        }
+        if (rank == 0)
+        {
+            if (restart_file != NULL)
+            {
+                printf("Restarting from %s after %d iterations, written by %d processes and read by %d\n", restart_file,
+                       options.restart_iterations, restart_processes, size);
+            }
+            else
+            {
+                printf("No checkpoint to restart from, starting from the grid\n");
+            }
+        }
+    }
+    if (options.checkpoint_interval > 0)
+    {
+        signal(SIGTERM, handleTerminate);
+    }
+
+    double t1, t2, time_taken;
+    if (rank == 0 && performance_testing)
+    {
+        t1 = MPI_Wtime();
+    }
+
+    // relax the grid, leaving this process's portion of the final grid in result
+    Grid result;
+    GridLayout layout;
+    int iterations;
+    if (options.method == METHOD_RED_BLACK)
+    {
+        iterations = relaxRedBlack(&options, &result, &layout, rank, size);
+    }
+    else if (options.method == METHOD_CG)
+    {
+        iterations = relaxConjugateGradient(&options, &result, &layout, rank, size);
+    }
+    else if (options.method == METHOD_MULTIGRID)
+    {
+        iterations = relaxMultigrid(&options, &result, &layout, rank, size);
+    }
+    else if (cartesian)
+    {
+        iterations = relaxCartesian(&options, &result, &layout);
+    }
+    else
+    {
+        iterations = relaxRowBlocks(&options, &result, &layout, rank, size);
+    }
+
+    printf("Process %d finishing\n", rank);
+    if (rank == 0 && options.interrupted)
+    {
+        printf("Stopped by SIGTERM after %d iterations, run again with -r to carry on from the checkpoint\n", iterations);
+    }
+    else if (rank == 0)
+    {
+        printf("Completed in %d iterations\n", iterations);
+    }
+
+    if (rank == 0 && performance_testing)
+    {
+        // record the time taken
+        t2 = MPI_Wtime();
+        time_taken = t2 - t1;
+
+        MPI_File handle;
+        MPI_Status status;
+        MPI_CHECK(MPI_File_open(MPI_COMM_SELF, performance_out, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &handle));
+
+        MPI_CHECK(MPI_File_seek(handle, 0, MPI_SEEK_END));
+        char *buf = malloc(100 * sizeof(char));
+
+        sprintf(buf, "%d, %f, %d, %f \n", options.dimension, options.precision, size, time_taken);
+        MPI_CHECK(MPI_File_write(handle, buf, strlen(buf), MPI_CHAR, &status));
+
+        MPI_CHECK(MPI_File_close(&handle));
+    }
+
+    // output the final grid to a file for correctness testing
+    if (write_to_file && !options.interrupted)
+    {
+        writeGrid(&result, out_file_name, options.dimension, &layout);
+    }
+
+    // clean up memory
+    free(file_name);
+    free(out_file_name);
+    free(checkpoint_name);
+    free(restart_file);
+    freeGridMem(&result);
+    if (workerPool != NULL)
+    {
+        destroyWorkerPool(workerPool);
+    }
+    if (ioHints != MPI_INFO_NULL)
+    {
+        MPI_Info_free(&ioHints);
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
+
+/**
+ * Relaxes the grid split between processes by rows, each process holding allocRows complete rows
+ * returns the number of iterations performed, with this process's rows of the final grid in result
+ */
+int relaxRowBlocks(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size)
+{
+    int dimension = options->dimension;
+    double precision = options->precision;
+    int halo_depth = options->halo_depth;
+
+    // Setup Grid
+    // Calculate each proccess' allocation
+    int allocStart;
+    int allocRows;
+    calculateAllocation(dimension, size, rank, &allocStart, &allocRows);
+
+    layout->row_start = allocStart;
+    layout->rows = allocRows;
+    layout->column_start = 0;
+    layout->columns = dimension;
+
+    // ghost rows are shipped from the neighbouring processes, so no process can hold more of them than its neighbours own
+    if (halo_depth < 1 || halo_depth > dimension / size)
+    {
+        if (rank == 0)
+        {
+            printf("-b must be between 1 and the smallest number of rows held by a process (%d)\n", dimension / size);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // the single row exchange keeps its neighbours' rows in separate buffers, deeper exchanges keep them as ghost rows
+    int halo = halo_depth > 1 ? halo_depth : 0;
+
+    // set up the two grids, reading the process's allocated portion of the overall grid from file
+    Grid in_grid = loadGrid(options, layout, halo, 0);
+    Grid out_grid = allocateGridMem(allocRows, dimension, halo, 0);
+
+    // assign overall edges in the outgrid (these never change)
+    copyEdges(&in_grid, &out_grid, rank, size);
+
+    // used to receive the row directly above or below the processes allocation from an adjacent process
+    double *top_edge_neighbours = (double *)malloc(sizeof(double) * dimension);
+    double *bottom_edge_neighbours = (double *)malloc(sizeof(double) * dimension);
+
+    // the exchange uses the same peers, counts and buffers every iteration, so its requests are only set up once
+    RowHalo row_halo;
+    initRowHalo(&row_halo, &in_grid, &out_grid, top_edge_neighbours, bottom_edge_neighbours, options->partitions, rank, size);
+
+    Checkpoint checkpoint;
+    if (options->checkpoint_interval > 0)
+    {
+        initCheckpoint(&checkpoint, options, layout);
+    }
+    Snapshot snapshot;
+    if (options->snapshot_interval > 0)
+    {
+        initSnapshot(&snapshot, options, layout);
+    }
+
+    // the global finished, boolean that signifies whether all processes have finished
+    int finished = 0;
+    int iterations = options->restart_iterations;
+
+    // with mixed precision, most of the iterations are done in single precision before the double precision ones below
+    if (options->mixed_precision)
+    {
+        iterations += relaxSinglePrecision(&in_grid, options->check, precision, rank, size);
+    }
+
+    // with a deeper halo, the whole relaxation is done in blocks of halo_depth iterations per exchange
+    if (halo_depth > 1)
+    {
+        iterations += relaxTemporalBlocking(&in_grid, &out_grid, halo_depth, precision, &options->check, rank, size);
+        finished = 1;
+    }
+
+    // The exchange is pipelined: each iteration computes its edge rows first and sends them straight away,
+    // so they travel while the interior is computed and are waiting for the neighbours at the start of the next iteration.
+    // Start by sending the initial edges
+    MPI_Request *requests = NULL;
+    if (!finished)
+    {
+        requests = startRowHalo(&row_halo, &in_grid);
+    }
+
+    while (!finished)
+    {
+        // Await neighbours and Calculate edges
+        // (the halo started last iteration carries the rows needed for this one)
+        double max_delta = 0;
+
+        // if not the first process (first process contains the overall top row which is constant)
+        // await neighbours and use them to calculate the top edge of the allocation
+        if (rank != 0)
+        {
+            MPI_Wait(&requests[HALO_RECV_TOP], MPI_STATUS_IGNORE);
+            max_delta = fmax(max_delta, relaxEdge(GRID_ROW(&in_grid, 0), top_edge_neighbours, GRID_ROW(&in_grid, 1), GRID_ROW(&out_grid, 0), dimension));
+        }
+        // if not the final process (final process contains the overall bottom row which is constant)
+        // await neighbours and use them to calculate the bottom edge of the allocation
+        if (rank != size - 1)
+        {
+            MPI_Wait(&requests[HALO_RECV_BOTTOM], MPI_STATUS_IGNORE);
+            max_delta = fmax(max_delta, relaxEdge(GRID_ROW(&in_grid, allocRows - 1), bottom_edge_neighbours, GRID_ROW(&in_grid, allocRows - 2), GRID_ROW(&out_grid, allocRows - 1), dimension));
+        }
+
+        //Send the new edges and receive the neighbours' new edges (Asynchronously)
+        // this uses out_grid's set of requests, whose sends were awaited at the end of the last iteration
+        MPI_Request *in_flight = requests;
+        requests = startRowHalo(&row_halo, &out_grid);
+
+        // Calculate internal
+        // i.e. ingrid[1] to ingrid[allocRows-1]
+        // each relaxation also reports the largest change it made, which is all that is needed to check completeness
+        // the rows are done in chunks, testing the requests in between so that the MPI library can progress them
+        int chunk = (allocRows - 2 + PROGRESS_POLLS - 1) / PROGRESS_POLLS;
+        chunk = chunk > 0 ? chunk : 1;
+        for (int row = 1; row < allocRows - 1; row += chunk)
+        {
+            int rows = row + chunk < allocRows - 1 ? chunk : allocRows - 1 - row;
+            max_delta = fmax(max_delta, relaxGrid(&in_grid, &out_grid, row, rows));
+
+            int flag;
+            MPI_Testall(4, requests, &flag, MPI_STATUSES_IGNORE);
+        }
+
+        // Await the sends from in_grid started last iteration, as next iteration writes its edges over them
+        MPI_Waitall(2, &in_flight[HALO_SEND_TOP], MPI_STATUSES_IGNORE);
+
+        iterations++;
+
+        // check if all processes' allocations are complete to the precision, when the check policy says to
+        // values outside the relaxed region are fixed, so the largest change over the relaxed cells covers the whole allocation
+        int status = checkConvergence(&options->check, max_delta, iterations, precision);
+        if (status == CHECK_FINISHED_PREVIOUS)
+        {
+            // the previous iteration's values are still in in_grid, so step back to them
+            swapGrids(&in_grid, &out_grid);
+            iterations--;
+        }
+        finished = status != CHECK_CONTINUE;
+
+        // if not all processes are finished, swap grids so that the old out_grid can be used as the input for the next iteration
+        // the swap only exchanges which grid is which, the requests in flight stay bound to their buffers
+        if (!finished)
+        {
+            swapGrids(&in_grid, &out_grid);
+
+            // the newest values are now in in_grid, ready to snapshot and checkpoint
+            if (options->snapshot_interval > 0 && iterations % options->snapshot_interval == 0)
+            {
+                takeSnapshot(&snapshot, &in_grid, iterations);
+            }
+            if (options->checkpoint_interval > 0 && updateCheckpoint(&checkpoint, &in_grid, iterations))
+            {
+                // stopping on SIGTERM, with the newest values moved back to out_grid where they are left on completion
+                swapGrids(&in_grid, &out_grid);
+                abandonConvergenceCheck(&options->check);
+                options->interrupted = 1;
+                finished = 1;
+            }
+        }
+    }
+
+    // the last iteration started an exchange nobody needs, but it has to be completed
+    if (requests != NULL)
+    {
+        MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+    }
+
+    if (options->checkpoint_interval > 0)
+    {
+        freeCheckpoint(&checkpoint);
+    }
+    if (options->snapshot_interval > 0)
+    {
+        freeSnapshot(&snapshot);
+    }
+    freeRowHalo(&row_halo);
+    free(top_edge_neighbours);
+    free(bottom_edge_neighbours);
+    freeGridMem(&in_grid);
+
+    *result = out_grid;
+    return iterations;
+}
+
+/**
+ * Function that is called once to copy the values at the 'edge' of one grid to another
+ * this function considers the grid as a whole (across processes)
+ */
+Grid *copyEdges(Grid *from_grid, Grid *to_grid, int rank, int size)
+{
+    int columns = from_grid->columns;
+
+    // Copy the first and last value of each row
+    for (int y = 0; y < from_grid->rows; y++)
+    {
+        GRID_ROW(to_grid, y)[0] = GRID_ROW(from_grid, y)[0];
+        GRID_ROW(to_grid, y)[columns - 1] = GRID_ROW(from_grid, y)[columns - 1];
+    }
+    // Copy the top row
+    if (rank == 0)
+    {
+        memcpy(GRID_ROW(to_grid, 0), GRID_ROW(from_grid, 0), sizeof(double) * columns);
+    }
+    //Copy the bottom row
+    if (rank == size - 1)
+    {
+        memcpy(GRID_ROW(to_grid, from_grid->rows - 1), GRID_ROW(from_grid, from_grid->rows - 1), sizeof(double) * columns);
+    }
+    return to_grid;
+}
+
+/**
+ * Gives a process its block of the overall grid, with the given ghost rows and columns,
+ * either read from the checkpoint being restarted from, generated in place from the -g generator (touching only the process's own values, with no file system involved)
+ * or read from the grid file
+ */
+Grid loadGrid(SolverOptions *options, GridLayout *layout, int halo, int column_halo)
+{
+    if (options->restart_file != NULL)
+    {
+        Grid grid = allocateGridMem(layout->rows, layout->columns, halo, column_halo);
+        MPI_File handle;
+        MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, options->restart_file, MPI_MODE_RDONLY, ioHints, &handle));
+        readBlock(handle, CHECKPOINT_DATA_OFFSET, &grid, options->dimension, layout);
+        MPI_CHECK(MPI_File_close(&handle));
+        return grid;
+    }
+    if (options->generator < 0)
+    {
+        return readGrid(options->file_name, options->dimension, layout, halo, column_halo);
+    }
+
+    Grid grid = allocateGridMem(layout->rows, layout->columns, halo, column_halo);
+    gridGenerateBlock(options->generator, options->seed, options->dimension, layout->row_start, layout->rows,
+                      layout->column_start, layout->columns, grid.data, grid.stride);
+    return grid;
+}
+
+/**
+ * Function used to read a process's block of the overall grid from a grid file in parallel
+ * files in the gridFormat.h container format are checked against the dimension and read by readGridChunks,
+ * raw files of doubles are read through a file view selecting the block, every process reading its portion in one collective call,
+ * letting MPI-IO merge the blocks into large contiguous file system requests (shaped by any -i hints)
+ */
+Grid readGrid(char *file_name, int dimension, GridLayout *layout, int halo, int column_halo)
+{
+
+    Grid read = allocateGridMem(layout->rows, layout->columns, halo, column_halo);
+
+    MPI_File handle;
+    MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, file_name, MPI_MODE_RDONLY, ioHints, &handle));
+
+    GridFileHeader header;
+    if (readGridHeader(handle, file_name, &header) == 0)
+    {
+        if (header.rows != (uint64_t)dimension || header.columns != (uint64_t)dimension)
+        {
+            if (layout->row_start == 0 && layout->column_start == 0)
+            {
+                fprintf(stderr, "%s holds a %llu x %llu grid, not %d x %d\n", file_name, (unsigned long long)header.rows,
+                        (unsigned long long)header.columns, dimension, dimension);
+            }
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        readGridChunks(handle, file_name, &header, &read, layout);
+    }
+    else
+    {
+        readBlock(handle, 0, &read, dimension, layout);
+    }
+    MPI_CHECK(MPI_File_close(&handle));
+
+    return read;
+}
+
+/**
+ * Collectively reads a process's block of an overall grid stored row-major as bare doubles from displacement onwards
+ * (a raw grid file, or the values of a checkpoint)
+ */
+void readBlock(MPI_File handle, MPI_Offset displacement, Grid *grid, int dimension, GridLayout *layout)
+{
+    MPI_Status status;
+    MPI_Datatype file_type, memory_type;
+    createBlockTypes(grid, dimension, layout, &file_type, &memory_type);
+
+    MPI_CHECK(MPI_File_set_view(handle, displacement, MPI_DOUBLE, file_type, "native", ioHints));
+
+    // the memory type skips the row padding, so the values go straight into the grid without a staging copy
+    MPI_CHECK(MPI_File_read_all(handle, grid->data, 1, memory_type, &status));
+
+    MPI_CHECK(MPI_Type_free(&file_type));
+    MPI_CHECK(MPI_Type_free(&memory_type));
+}
+
+/**
+ * Reads the header of an open grid file on the first process and shares it with the others
+ * returns 0 if the file is in the gridFormat.h container format, 1 if it is a raw grid of doubles
+ * (aborts if it is a container this build cannot read)
+ */
+int readGridHeader(MPI_File handle, char *file_name, GridFileHeader *header)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // files too small to hold a header are raw grids, and are left with a magic that does not match
+    memset(header, 0, sizeof(GridFileHeader));
+    if (rank == 0)
+    {
+        MPI_Status status;
+        MPI_CHECK(MPI_File_read_at(handle, 0, header, sizeof(GridFileHeader), MPI_BYTE, &status));
+    }
+    MPI_CHECK(MPI_Bcast(header, sizeof(GridFileHeader), MPI_BYTE, 0, MPI_COMM_WORLD));
+
+    const char *error;
+    int format = gridCheckHeader(header, &error);
+    if (format < 0)
+    {
+        if (rank == 0)
+        {
+            fprintf(stderr, "%s is a grid file with %s\n", file_name, error);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return format;
+}
+
+/**
+ * Finds the dimension of the grid in a file, for when -d is not given
+ * returns -1 if the file is a raw grid, which does not record its dimension
+ */
+int readGridDimension(char *file_name)
+{
+    MPI_File handle;
+    GridFileHeader header;
+    MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, file_name, MPI_MODE_RDONLY, ioHints, &handle));
+    int format = readGridHeader(handle, file_name, &header);
+    MPI_CHECK(MPI_File_close(&handle));
+    return format == 0 && header.rows == header.columns ? (int)header.rows : -1;
+}
+
+/**
+ * Collectively reads bytes from a file at the given offset, in pieces small enough for an int count
+ * every process takes part in the same number of reads, reading nothing once its own bytes are done
+ */
+void readAtAll(MPI_File handle, MPI_Offset offset, unsigned char *buffer, size_t bytes)
+{
+    const size_t piece = (size_t)1 << 30;
+    unsigned long long pieces = (bytes + piece - 1) / piece, most_pieces;
+    MPI_CHECK(MPI_Allreduce(&pieces, &most_pieces, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD));
+
+    for (unsigned long long i = 0; i < most_pieces; i++)
+    {
+        size_t done = (size_t)i * piece;
+        int count = done < bytes ? (int)(bytes - done < piece ? bytes - done : piece) : 0;
+        MPI_Status status;
+        MPI_CHECK(MPI_File_read_at_all(handle, offset + (MPI_Offset)done, buffer + (done < bytes ? done : 0), count, MPI_BYTE, &status));
+    }
+}
+
+/**
+ * Reads a process's block of the overall grid from a file in the gridFormat.h container format
+ * each process reads only the run of chunks covering its rows, in one collective read, then decompresses them
+ * and checks each against the checksum in the index
+ */
+void readGridChunks(MPI_File handle, char *file_name, GridFileHeader *header, Grid *grid, GridLayout *layout)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    size_t columns = (size_t)header->columns;
+    uint64_t chunk_rows = header->chunk_rows;
+
+    // the index is small, so one process reads and checks it for everyone
+    size_t index_bytes = (size_t)header->chunk_count * sizeof(GridChunk);
+    GridChunk *chunks = malloc(index_bytes);
+    if (rank == 0)
+    {
+        MPI_Status status;
+        MPI_CHECK(MPI_File_read_at(handle, sizeof(GridFileHeader), chunks, (int)index_bytes, MPI_BYTE, &status));
+        if (gridChecksum(chunks, index_bytes) != header->index_checksum)
+        {
+            fprintf(stderr, "the chunk index of %s is corrupt\n", file_name);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_CHECK(MPI_Bcast(chunks, (int)index_bytes, MPI_BYTE, 0, MPI_COMM_WORLD));
+
+    // chunks are stored in order, so a process's chunks are one contiguous run of the file
+    uint64_t first = (uint64_t)layout->row_start / chunk_rows;
+    uint64_t last = layout->rows > 0 ? (uint64_t)(layout->row_start + layout->rows - 1) / chunk_rows : first - 1;
+    MPI_Offset start = layout->rows > 0 ? (MPI_Offset)chunks[first].offset : 0;
+    size_t bytes = layout->rows > 0 ? (size_t)(chunks[last].offset + chunks[last].bytes - chunks[first].offset) : 0;
+    unsigned char *stored = malloc(bytes > 0 ? bytes : 1);
+    readAtAll(handle, start, stored, bytes);
+
+    double *values = malloc(sizeof(double) * chunk_rows * columns);
+    for (uint64_t c = first; layout->rows > 0 && c <= last; c++)
+    {
+        uint64_t chunk_start = c * chunk_rows;
+        uint64_t rows = header->rows - chunk_start < chunk_rows ? header->rows - chunk_start : chunk_rows;
+        size_t count = (size_t)rows * columns;
+        const unsigned char *data = stored + (chunks[c].offset - (uint64_t)start);
+
+        int corrupt;
+        if (header->codec == GRID_CODEC_NONE)
+        {
+            corrupt = chunks[c].bytes != count * sizeof(double);
+            if (!corrupt)
+            {
+                memcpy(values, data, count * sizeof(double));
+            }
+        }
+        else
+        {
+            corrupt = gridDecompress(data, (size_t)chunks[c].bytes, values, count) != 0;
+        }
+        if (corrupt || gridChecksum(values, count * sizeof(double)) != chunks[c].checksum)
+        {
+            fprintf(stderr, "chunk %llu of %s is corrupt\n", (unsigned long long)c, file_name);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        // copy out the rows (and columns) of the chunk that belong to this process
+        uint64_t from = chunk_start > (uint64_t)layout->row_start ? chunk_start : (uint64_t)layout->row_start;
+        uint64_t to = chunk_start + rows < (uint64_t)(layout->row_start + layout->rows) ? chunk_start + rows : (uint64_t)(layout->row_start + layout->rows);
+        for (uint64_t y = from; y < to; y++)
+        {
+            memcpy(GRID_ROW(grid, y - layout->row_start), values + (y - chunk_start) * columns + layout->column_start,
+                   sizeof(double) * layout->columns);
+        }
+    }
+
+    free(values);
+    free(stored);
+    free(chunks);
+}
+
+/**
+ * Adds the hints in a comma separated list of key=value pairs (e.g. cb_nodes=8,striping_unit=4194304) to info,
+ * creating it if it is MPI_INFO_NULL, hints the MPI library does not recognise are ignored by it
+ * returns 0 on success, -1 if a pair has no key or value
+ */
+int parseIoHints(char *arg, MPI_Info *info)
+{
+    if (*info == MPI_INFO_NULL)
+    {
+        MPI_CHECK(MPI_Info_create(info));
+    }
+    for (char *pair = strtok(arg, ","); pair != NULL; pair = strtok(NULL, ","))
+    {
+        char *value = strchr(pair, '=');
+        if (value == NULL || value == pair || value[1] == '\0')
+        {
+            return -1;
+        }
+        *value++ = '\0';
+        MPI_CHECK(MPI_Info_set(*info, pair, value));
+    }
+    return 0;
+}
+
+/**
+ * Function used to write a process's block of the overall grid to a binary file at the correct position
+ * as with readGrid, every process writes its block in one collective call
+ */
+void writeGrid(Grid *grid, char *file_name, int dimension, GridLayout *layout)
+{
+
+    MPI_File handle;
+    MPI_Status status;
+    MPI_Datatype file_type, memory_type;
+    createBlockTypes(grid, dimension, layout, &file_type, &memory_type);
+
+    MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, file_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, ioHints, &handle));
+    MPI_CHECK(MPI_File_set_view(handle, 0, MPI_DOUBLE, file_type, "native", ioHints));
+
+    MPI_CHECK(MPI_File_write_all(handle, grid->data, 1, memory_type, &status));
+    MPI_CHECK(MPI_File_close(&handle));
+
+    MPI_CHECK(MPI_Type_free(&file_type));
+    MPI_CHECK(MPI_Type_free(&memory_type));
+}
+
+/**
+ * Builds the datatypes describing a process's block: where it sits in the overall row-major file,
+ * and which values of the grid in memory hold it (skipping the row padding and any ghost values)
+ */
+void createBlockTypes(Grid *grid, int dimension, GridLayout *layout, MPI_Datatype *file_type, MPI_Datatype *memory_type)
+{
+    int sizes[2] = {dimension, dimension};
+    int subsizes[2] = {layout->rows, layout->columns};
+    int starts[2] = {layout->row_start, layout->column_start};
+    MPI_CHECK(MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_DOUBLE, file_type));
+    MPI_CHECK(MPI_Type_commit(file_type));
+
+    MPI_CHECK(MPI_Type_vector(layout->rows, layout->columns, grid->stride, MPI_DOUBLE, memory_type));
+    MPI_CHECK(MPI_Type_commit(memory_type));
+}
+
+/**
+ * Sets up checkpointing from a -C arguement: <iterations>[:<file name>]
+ * returns 0 on success, -1 if the arguement is not recognised
+ */
+int parseCheckpoint(const char *arg, SolverOptions *options)
+{
+    char *end;
+    long interval = strtol(arg, &end, 10);
+    if (end == arg || interval < 1 || interval > INT_MAX || (*end != '\0' && (*end != ':' || end[1] == '\0')))
+    {
+        return -1;
+    }
+    options->checkpoint_interval = (int)interval;
+    options->checkpoint_name = *end == ':' ? end + 1 : NULL;
+    return 0;
+}
+
+/**
+ * Finds the latest complete checkpoint of a dimension x dimension grid among <name>.0 and <name>.1
+ * returns the iterations it holds, with which file it is in index and how many processes wrote it in processes,
+ * or 0 if neither file holds a complete checkpoint, a header of 0 iterations from 0 processes marks one still being written
+ */
+int findCheckpoint(char *name, int dimension, int *index, int *processes)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // only the first process looks, missing files are expected so are not errors
+    int found[3] = {0, 1, 0};
+    if (rank == 0)
+    {
+        char *file_name = malloc(strlen(name) + 3);
+        for (int i = 0; i < 2; i++)
+        {
+            MPI_File handle;
+            CheckpointHeader header;
+            MPI_Status status;
+            int count = 0;
+            sprintf(file_name, "%s.%d", name, i);
+            if (MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &handle) != MPI_SUCCESS)
+            {
+                continue;
+            }
+            if (MPI_File_read_at(handle, 0, &header, sizeof(CheckpointHeader), MPI_BYTE, &status) == MPI_SUCCESS)
+            {
+                MPI_Get_count(&status, MPI_BYTE, &count);
+            }
+            MPI_File_close(&handle);
+
+            if (count == sizeof(CheckpointHeader) && memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 &&
+                header.dimension == dimension && header.processes > 0 && header.iterations > found[0])
+            {
+                found[0] = (int)header.iterations;
+                found[1] = i;
+                found[2] = (int)header.processes;
+            }
+        }
+        free(file_name);
+    }
+    MPI_CHECK(MPI_Bcast(found, 3, MPI_INT, 0, MPI_COMM_WORLD));
+    *index = found[1];
+    *processes = found[2];
+    return found[0];
+}
+
+/**
+ * Sets up checkpoints of a process's block every options->checkpoint_interval iterations
+ * the first goes to whichever file was not restarted from, so the checkpoint restarted from survives until it is replaced,
+ * a run that is not restarted starts a new series, removing any old checkpoints that a later restart could pick up instead
+ */
+void initCheckpoint(Checkpoint *checkpoint, SolverOptions *options, GridLayout *layout)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    for (int i = 0; i < 2; i++)
+    {
+        checkpoint->file_names[i] = malloc(strlen(options->checkpoint_name) + 3);
+        sprintf(checkpoint->file_names[i], "%s.%d", options->checkpoint_name, i);
+        if (options->restart_file == NULL && rank == 0)
+        {
+            MPI_File_delete(checkpoint->file_names[i], MPI_INFO_NULL);
+        }
+    }
+    checkpoint->next_file = options->restart_index ^ 1;
+    checkpoint->interval = options->checkpoint_interval;
+    checkpoint->dimension = options->dimension;
+    checkpoint->layout = *layout;
+    checkpoint->staging = allocateGridMem(layout->rows, layout->columns, 0, 0);
+    checkpoint->handle = MPI_FILE_NULL;
+    checkpoint->request = MPI_REQUEST_NULL;
+}
+
+/**
+ * Starts writing a checkpoint of a process's block after the given iterations
+ * the block is copied aside and written with a non-blocking collective write, so relaxation carries on while it is written
+ */
+void startCheckpoint(Checkpoint *checkpoint, Grid *grid, int iterations)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    GridLayout *layout = &checkpoint->layout;
+    Grid *staging = &checkpoint->staging;
+
+    for (int s = 0; s < layout->rows; s++)
+    {
+        memcpy(GRID_ROW(staging, s), GRID_ROW(grid, s), sizeof(double) * layout->columns);
+    }
+
+    MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, checkpoint->file_names[checkpoint->next_file], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                            ioHints, &checkpoint->handle));
+
+    // the header is cleared (and synced) before any values are overwritten, so a checkpoint cut short is never taken for a complete one
+    if (rank == 0)
+    {
+        CheckpointHeader header;
+        MPI_Status status;
+        memset(&header, 0, sizeof(CheckpointHeader));
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.dimension = checkpoint->dimension;
+        MPI_CHECK(MPI_File_write_at(checkpoint->handle, 0, &header, sizeof(CheckpointHeader), MPI_BYTE, &status));
+    }
+    MPI_CHECK(MPI_File_sync(checkpoint->handle));
+
+    MPI_Datatype file_type, memory_type;
+    createBlockTypes(staging, checkpoint->dimension, layout, &file_type, &memory_type);
+    MPI_CHECK(MPI_File_set_view(checkpoint->handle, CHECKPOINT_DATA_OFFSET, MPI_DOUBLE, file_type, "native", ioHints));
+#if MPI_VERSION > 3 || (MPI_VERSION == 3 && MPI_SUBVERSION >= 1)
+    MPI_CHECK(MPI_File_iwrite_all(checkpoint->handle, staging->data, 1, memory_type, &checkpoint->request));
+#else
+    // without MPI-3.1's non-blocking collective I/O, the write is done here and only the completion is put off
+    MPI_Status status;
+    MPI_CHECK(MPI_File_write_all(checkpoint->handle, staging->data, 1, memory_type, &status));
+#endif
+    // the types are only released by MPI once the write no longer needs them
+    MPI_CHECK(MPI_Type_free(&file_type));
+    MPI_CHECK(MPI_Type_free(&memory_type));
+
+    checkpoint->iterations = iterations;
+    checkpoint->due = iterations + (checkpoint->interval < CHECKPOINT_DRAIN_ITERATIONS ? checkpoint->interval : CHECKPOINT_DRAIN_ITERATIONS);
+}
+
+/**
+ * Waits for the checkpoint being written (if there is one) to reach the file, then marks it complete
+ * by filling in the iterations in its header
+ */
+void finishCheckpoint(Checkpoint *checkpoint)
+{
+    if (checkpoint->handle == MPI_FILE_NULL)
+    {
+        return;
+    }
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // every process's values must be in the file before the header says they are
+    MPI_CHECK(MPI_Wait(&checkpoint->request, MPI_STATUS_IGNORE));
+    MPI_CHECK(MPI_File_sync(checkpoint->handle));
+    MPI_CHECK(MPI_File_set_view(checkpoint->handle, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL));
+    MPI_CHECK(MPI_Barrier(MPI_COMM_WORLD));
+    if (rank == 0)
+    {
+        CheckpointHeader header;
+        MPI_Status status;
+        memset(&header, 0, sizeof(CheckpointHeader));
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.dimension = checkpoint->dimension;
+        header.iterations = checkpoint->iterations;
+        header.processes = size;
+        MPI_CHECK(MPI_File_write_at(checkpoint->handle, 0, &header, sizeof(CheckpointHeader), MPI_BYTE, &status));
+        printf("Checkpointed %d iterations to %s\n", checkpoint->iterations, checkpoint->file_names[checkpoint->next_file]);
+    }
+    MPI_CHECK(MPI_File_close(&checkpoint->handle));
+    checkpoint->next_file ^= 1;
+}
+
+/**
+ * Called after every iteration with the newest values: completes the checkpoint being written once it is due,
+ * starts a new one every interval iterations, and on SIGTERM writes a final checkpoint straight away
+ * returns 1 if the relaxation should stop because of SIGTERM, 0 to carry on
+ */
+int updateCheckpoint(Checkpoint *checkpoint, Grid *grid, int iterations)
+{
+    if (checkpoint->handle != MPI_FILE_NULL)
+    {
+        // give the MPI library a chance to progress the write
+        int flag;
+        MPI_CHECK(MPI_Test(&checkpoint->request, &flag, MPI_STATUS_IGNORE));
+        if (iterations >= checkpoint->due)
+        {
+            finishCheckpoint(checkpoint);
+        }
+    }
+
+    // the signal may reach the processes at different times, so they agree on it before acting on it
+    if (iterations % CHECKPOINT_SIGNAL_POLL == 0)
+    {
+        int terminate = terminationRequested, any_terminate;
+        MPI_CHECK(MPI_Allreduce(&terminate, &any_terminate, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD));
+        if (any_terminate)
+        {
+            finishCheckpoint(checkpoint);
+            startCheckpoint(checkpoint, grid, iterations);
+            finishCheckpoint(checkpoint);
+            return 1;
+        }
+    }
+
+    if (iterations % checkpoint->interval == 0)
+    {
+        // only one checkpoint is written at a time
+        finishCheckpoint(checkpoint);
+        startCheckpoint(checkpoint, grid, iterations);
+    }
+    return 0;
+}
+
+/**
+ * Completes any checkpoint still being written and releases the checkpoint state
+ */
+void freeCheckpoint(Checkpoint *checkpoint)
+{
+    finishCheckpoint(checkpoint);
+    freeGridMem(&checkpoint->staging);
+    free(checkpoint->file_names[0]);
+    free(checkpoint->file_names[1]);
+}
+
+/**
+ * Sets up snapshots from a -S arguement: <iterations>[:<size>]
+ * returns 0 on success, -1 if the arguement is not recognised
+ */
+int parseSnapshot(const char *arg, SolverOptions *options)
+{
+    int interval, size = SNAPSHOT_DEFAULT_SIZE;
+    char extra;
+    if ((sscanf(arg, "%d%c", &interval, &extra) != 1 && (sscanf(arg, "%d:%d%c", &interval, &size, &extra) != 2)) || interval < 1 || size < 1)
+    {
+        return -1;
+    }
+    options->snapshot_interval = interval;
+    options->snapshot_size = size;
+    return 0;
+}
+
+/**
+ * The first overall row (or column) of a dimension long side that falls in the given snapshot row (or column)
+ * of a size long side, for every value y to fall in snapshot value y * size / dimension
+ */
+static int snapshotStart(int index, int size, int dimension)
+{
+    return (int)(((long long)index * dimension + size - 1) / size);
+}
+
+/**
+ * Sets up snapshots of the grid every options->snapshot_interval iterations, of at most options->snapshot_size values a side
+ */
+void initSnapshot(Snapshot *snapshot, SolverOptions *options, GridLayout *layout)
+{
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+
+    int dimension = options->dimension;
+    int size = options->snapshot_size < dimension ? options->snapshot_size : dimension;
+    snapshot->interval = options->snapshot_interval;
+    snapshot->size = size;
+    snapshot->dimension = dimension;
+    snapshot->layout = *layout;
+
+    // blocks of the grid rarely line up with blocks of the snapshot, so the snapshot values at the block's edges are partial sums
+    GridLayout *covered = &snapshot->covered;
+    covered->row_start = (int)((long long)layout->row_start * size / dimension);
+    covered->rows = layout->rows > 0 ? (int)((long long)(layout->row_start + layout->rows - 1) * size / dimension) - covered->row_start + 1 : 0;
+    covered->column_start = (int)((long long)layout->column_start * size / dimension);
+    covered->columns = layout->columns > 0 ? (int)((long long)(layout->column_start + layout->columns - 1) * size / dimension) - covered->column_start + 1 : 0;
+
+    snapshot->column_map = malloc(sizeof(int) * (layout->columns > 0 ? layout->columns : 1));
+    for (int x = 0; x < layout->columns; x++)
+    {
+        snapshot->column_map[x] = (int)((long long)(layout->column_start + x) * size / dimension) - covered->column_start;
+    }
+    snapshot->sums = malloc(sizeof(double) * ((size_t)covered->rows * covered->columns + 1));
+
+    // the first process needs to know where every process's sums go
+    snapshot->blocks = rank == 0 ? malloc(sizeof(GridLayout) * processes) : NULL;
+    MPI_CHECK(MPI_Gather(covered, 4, MPI_INT, snapshot->blocks, 4, MPI_INT, 0, MPI_COMM_WORLD));
+    snapshot->counts = NULL;
+    snapshot->displacements = NULL;
+    snapshot->gathered = NULL;
+    snapshot->snapshot = NULL;
+    if (rank == 0)
+    {
+        snapshot->counts = malloc(sizeof(int) * processes);
+        snapshot->displacements = malloc(sizeof(int) * processes);
+        int total = 0;
+        for (int p = 0; p < processes; p++)
+        {
+            snapshot->counts[p] = snapshot->blocks[p].rows * snapshot->blocks[p].columns;
+            snapshot->displacements[p] = total;
+            total += snapshot->counts[p];
+        }
+        snapshot->gathered = malloc(sizeof(double) * (total > 0 ? total : 1));
+        snapshot->snapshot = malloc(sizeof(double) * (size_t)size * size);
+    }
+}
+
+/**
+ * Takes a snapshot of the grid after the given iterations, written by the first process to grids/snapshot_<dimension>_<iterations>.bin
+ * in the gridFormat.h format, each process summing its own values so that only the (small) snapshot is gathered
+ */
+void takeSnapshot(Snapshot *snapshot, Grid *grid, int iterations)
+{
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    int size = snapshot->size;
+    int dimension = snapshot->dimension;
+    GridLayout *layout = &snapshot->layout;
+    GridLayout *covered = &snapshot->covered;
+
+    memset(snapshot->sums, 0, sizeof(double) * (size_t)covered->rows * covered->columns);
+    for (int s = 0; s < layout->rows; s++)
+    {
+        const double *row = GRID_ROW(grid, s);
+        double *sums = snapshot->sums + (size_t)((long long)(layout->row_start + s) * size / dimension - covered->row_start) * covered->columns;
+        for (int x = 0; x < layout->columns; x++)
+        {
+            sums[snapshot->column_map[x]] += row[x];
+        }
+    }
+
+    MPI_CHECK(MPI_Gatherv(snapshot->sums, covered->rows * covered->columns, MPI_DOUBLE, snapshot->gathered, snapshot->counts,
+                          snapshot->displacements, MPI_DOUBLE, 0, MPI_COMM_WORLD));
+    if (rank != 0)
+    {
+        return;
+    }
+
+    // add up the partial sums, then divide each by the number of values it covers
+    double *values = snapshot->snapshot;
+    memset(values, 0, sizeof(double) * (size_t)size * size);
+    for (int p = 0; p < processes; p++)
+    {
+        GridLayout *block = &snapshot->blocks[p];
+        const double *sums = snapshot->gathered + snapshot->displacements[p];
+        for (int y = 0; y < block->rows; y++)
+        {
+            for (int x = 0; x < block->columns; x++)
+            {
+                values[(size_t)(block->row_start + y) * size + block->column_start + x] += sums[(size_t)y * block->columns + x];
+            }
+        }
+    }
+    for (int y = 0; y < size; y++)
+    {
+        int rows = snapshotStart(y + 1, size, dimension) - snapshotStart(y, size, dimension);
+        for (int x = 0; x < size; x++)
+        {
+            int columns = snapshotStart(x + 1, size, dimension) - snapshotStart(x, size, dimension);
+            values[(size_t)y * size + x] /= (double)rows * columns;
+        }
+    }
+
+    char file_name[64];
+    sprintf(file_name, "grids/snapshot_%d_%d.bin", dimension, iterations);
+    GridFileWriter writer;
+    uint64_t chunk_rows = gridDefaultChunkRows(size);
+    int failed = gridWriterOpen(&writer, file_name, size, size, chunk_rows, GRID_CODEC_NONE) != 0;
+    for (uint64_t row = 0; row < (uint64_t)size && !failed; row += chunk_rows)
+    {
+        uint64_t rows = size - row < chunk_rows ? size - row : chunk_rows;
+        failed |= gridWriterAppend(&writer, values + row * size, rows) != 0;
+    }
+    if (writer.file != NULL)
+    {
+        failed |= gridWriterClose(&writer) != 0;
+    }
+    if (failed)
+    {
+        fprintf(stderr, "Unable to write snapshot %s\n", file_name);
+    }
+}
+
+/**
+ * Releases the snapshot state
+ */
+void freeSnapshot(Snapshot *snapshot)
+{
+    free(snapshot->column_map);
+    free(snapshot->sums);
+    free(snapshot->blocks);
+    free(snapshot->counts);
+    free(snapshot->displacements);
+    free(snapshot->gathered);
+    free(snapshot->snapshot);
+}
+
+/**
+ * Splits total rows (or columns) between parts as evenly as possible, giving the start and count of the given part
+ */
+void calculateAllocation(int total, int parts, int index, int *start, int *count)
+{
+    int remainder = total % parts;
+
+    // the total number of rows that cannot be distributed evenly is calculated as remainder
+    // all parts with index less than the remainder are then handed on extra row such that all rows are assigned
+
+    // for the group of parts that are assigned extra rows we can calculate the start location of the allocation simply,
+    // the later parts have a different(smaller) count so we must add the remainder to account for the extra rows
+    if (index < remainder)
+    {
+        *count = total / parts + 1;
+        *start = index * *count;
+    }
+    else
+    {
+        *count = total / parts;
+        //remainder is added to account for the total number of extra rows that have been allocated
+        *start = index * *count + remainder;
+    }
+}
+
+/**
+ * Relaxes the grid split between processes in both directions, over a two dimensional Cartesian arrangement of processes
+ * each process exchanges a row with the processes above and below it and a column with those either side,
+ * so the values exchanged per process shrink as the number of processes grows
+ * returns the number of iterations performed, with this process's block of the final grid in result
+ */
+int relaxCartesian(SolverOptions *options, Grid *result, GridLayout *layout)
+{
+    int dimension = options->dimension;
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // let MPI choose the most square arrangement of the processes
+    int dims[2] = {0, 0};
+    int periods[2] = {0, 0};
+    MPI_CHECK(MPI_Dims_create(size, 2, dims));
+    if (dimension / dims[0] < 1 || dimension / dims[1] < 1)
+    {
+        printf("-2 needs a dimension of at least %d for a %d x %d arrangement of processes\n", dims[0], dims[0], dims[1]);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_Comm cart;
+    int cart_rank, coords[2];
+    MPI_CHECK(MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &cart));
+    MPI_CHECK(MPI_Comm_rank(cart, &cart_rank));
+    MPI_CHECK(MPI_Cart_coords(cart, cart_rank, 2, coords));
+
+    // processes on the edges of the overall grid have MPI_PROC_NULL neighbours, so their sends and receives do nothing
+    int above, below, left, right;
+    MPI_CHECK(MPI_Cart_shift(cart, 0, 1, &above, &below));
+    MPI_CHECK(MPI_Cart_shift(cart, 1, 1, &left, &right));
+
+    calculateAllocation(dimension, dims[0], coords[0], &layout->row_start, &layout->rows);
+    calculateAllocation(dimension, dims[1], coords[1], &layout->column_start, &layout->columns);
+    int rows = layout->rows;
+    int columns = layout->columns;
+
+    // both grids hold a ghost row and ghost column on every side of the block for the neighbours' values
+    Grid in_grid = loadGrid(options, layout, 1, 1);
+    Grid out_grid = allocateGridMem(rows, columns, 1, 1);
+
+    // every value outside the relaxed region is fixed, so copying everything once gives the outgrid its edges
+    memcpy(out_grid.base, in_grid.base, sizeof(double) * (size_t)in_grid.stride * (rows + 2));
+
+    // the region of the block that is relaxed, which leaves out the edges of the overall grid
+    int bounds[4] = {above == MPI_PROC_NULL ? 1 : 0, below == MPI_PROC_NULL ? rows - 1 : rows,
+                     left == MPI_PROC_NULL ? 1 : 0, right == MPI_PROC_NULL ? columns - 1 : columns};
+
+    // a column of the block is one value from each row, a stride apart
+    MPI_Datatype column_type;
+    MPI_CHECK(MPI_Type_vector(rows, 1, in_grid.stride, MPI_DOUBLE, &column_type));
+    MPI_CHECK(MPI_Type_commit(&column_type));
+
+    // persistent requests receive the neighbours' edges into the ghost rows and columns, and send this block's edges
+    // they are bound to their buffers, so there is a set for each grid, picked by which one is being relaxed from
+    MPI_Request halo_requests[2][8];
+    Grid *grids[2] = {&in_grid, &out_grid};
+    double *slabs[2] = {in_grid.data, out_grid.data};
+    for (int g = 0; g < 2; g++)
+    {
+        Grid *grid = grids[g];
+        MPI_Request *requests = halo_requests[g];
+        MPI_CHECK(MPI_Recv_init(GRID_ROW(grid, -1), columns, MPI_DOUBLE, above, SEND_BOTTOM_EDGE_TAG, cart, &requests[0]));
+        MPI_CHECK(MPI_Recv_init(GRID_ROW(grid, rows), columns, MPI_DOUBLE, below, SEND_TOP_EDGE_TAG, cart, &requests[1]));
+        MPI_CHECK(MPI_Recv_init(GRID_ROW(grid, 0) - 1, 1, column_type, left, SEND_RIGHT_EDGE_TAG, cart, &requests[2]));
+        MPI_CHECK(MPI_Recv_init(GRID_ROW(grid, 0) + columns, 1, column_type, right, SEND_LEFT_EDGE_TAG, cart, &requests[3]));
+
+        MPI_CHECK(MPI_Send_init(GRID_ROW(grid, 0), columns, MPI_DOUBLE, above, SEND_TOP_EDGE_TAG, cart, &requests[4]));
+        MPI_CHECK(MPI_Send_init(GRID_ROW(grid, rows - 1), columns, MPI_DOUBLE, below, SEND_BOTTOM_EDGE_TAG, cart, &requests[5]));
+        MPI_CHECK(MPI_Send_init(GRID_ROW(grid, 0), 1, column_type, left, SEND_LEFT_EDGE_TAG, cart, &requests[6]));
+        MPI_CHECK(MPI_Send_init(GRID_ROW(grid, 0) + columns - 1, 1, column_type, right, SEND_RIGHT_EDGE_TAG, cart, &requests[7]));
+    }
+
+    Checkpoint checkpoint;
+    if (options->checkpoint_interval > 0)
+    {
+        initCheckpoint(&checkpoint, options, layout);
+    }
+    Snapshot snapshot;
+    if (options->snapshot_interval > 0)
+    {
+        initSnapshot(&snapshot, options, layout);
+    }
+
+    int finished = 0;
+    int iterations = options->restart_iterations;
+    while (!finished)
+    {
+        // Exchange edges with the neighbours (Asynchronously)
+        MPI_Request *requests = halo_requests[in_grid.data == slabs[0] ? 0 : 1];
+        MPI_CHECK(MPI_Startall(8, requests));
+
+        // Calculate the values that do not depend on the neighbours while the edges are in flight
+        double max_delta = relaxRegionParallel(&in_grid, &out_grid, 1, rows - 1, 1, columns - 1, bounds);
+
+        MPI_CHECK(MPI_Waitall(8, requests, MPI_STATUSES_IGNORE));
+
+        // then the outer ring of the block, which does
+        max_delta = fmax(max_delta, relaxRegion(&in_grid, &out_grid, 0, 1, 0, columns, bounds));
+        max_delta = fmax(max_delta, relaxRegion(&in_grid, &out_grid, rows - 1 > 0 ? rows - 1 : 1, rows, 0, columns, bounds));
+        max_delta = fmax(max_delta, relaxRegion(&in_grid, &out_grid, 1, rows - 1, 0, 1, bounds));
+        max_delta = fmax(max_delta, relaxRegion(&in_grid, &out_grid, 1, rows - 1, columns - 1 > 0 ? columns - 1 : 1, columns, bounds));
+
+        iterations++;
+
+        int status = checkConvergence(&options->check, max_delta, iterations, options->precision);
+        if (status == CHECK_FINISHED_PREVIOUS)
+        {
+            // the previous iteration's values are still in in_grid, so step back to them
+            swapGrids(&in_grid, &out_grid);
+            iterations--;
+        }
+        finished = status != CHECK_CONTINUE;
+        if (!finished)
+        {
+            swapGrids(&in_grid, &out_grid);
+            if (options->snapshot_interval > 0 && iterations % options->snapshot_interval == 0)
+            {
+                takeSnapshot(&snapshot, &in_grid, iterations);
+            }
+            if (options->checkpoint_interval > 0 && updateCheckpoint(&checkpoint, &in_grid, iterations))
+            {
+                swapGrids(&in_grid, &out_grid);
+                abandonConvergenceCheck(&options->check);
+                options->interrupted = 1;
+                finished = 1;
+            }
+        }
+    }
+
+    if (options->checkpoint_interval > 0)
+    {
+        freeCheckpoint(&checkpoint);
+    }
+    if (options->snapshot_interval > 0)
+    {
+        freeSnapshot(&snapshot);
+    }
+
+    for (int g = 0; g < 2; g++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            MPI_CHECK(MPI_Request_free(&halo_requests[g][i]));
+        }
+    }
+    MPI_CHECK(MPI_Type_free(&column_type));
+    MPI_CHECK(MPI_Comm_free(&cart));
+    freeGridMem(&in_grid);
+
+    *result = out_grid;
+    return iterations;
+}
+
+/**
+ * Starts a pool of thread_count - 1 worker threads, which together with the main thread share out relaxRegionParallel jobs
+ * the workers stay parked on the pool's start barrier between jobs, so threads are created once per run rather than per iteration
+ */
+WorkerPool *createWorkerPool(int thread_count)
+{
+    WorkerPool *pool = (WorkerPool *)malloc(sizeof(WorkerPool));
+    pool->thread_count = thread_count;
+    pool->shutdown = 0;
+    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
+    pool->args = (WorkerArgs *)malloc(sizeof(WorkerArgs) * thread_count);
+    if (posix_memalign((void **)&pool->deltas, CACHE_LINE_BYTES, sizeof(PaddedDelta) * thread_count) != 0)
+    {
+        fprintf(stderr, "createWorkerPool: unable to allocate reduction slots\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    //barriers are used to synchronise all worker threads + the main thread
+    if (pthread_barrier_init(&pool->start, NULL, (unsigned int)thread_count) != 0 ||
+        pthread_barrier_init(&pool->done, NULL, (unsigned int)thread_count) != 0)
+    {
+        perror("barrier init");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // the main thread takes share 0 of every job itself
+    for (int i = 1; i < thread_count; i++)
+    {
+        pool->args[i].pool = pool;
+        pool->args[i].index = i;
+        if (pthread_create(&pool->threads[i], NULL, poolWorker, &pool->args[i]))
+        {
+            perror("thread create");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    return pool;
+}
+
+/**
+ * Stops the pool's worker threads and releases its memory
+ */
+void destroyWorkerPool(WorkerPool *pool)
+{
+    // workers check the flag after the start barrier, so release them with it set and they return
+    pool->shutdown = 1;
+    pthread_barrier_wait(&pool->start);
+    for (int i = 1; i < pool->thread_count; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_barrier_destroy(&pool->start);
+    pthread_barrier_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->args);
+    free(pool->deltas);
+    free(pool);
+}
+
+/**
+ * Loops over the pool's jobs, relaxing its share of each, until the pool is shut down
+ * worker threads never make MPI calls, which is all MPI_THREAD_FUNNELED allows
+ */
+void *poolWorker(void *dummyArgs)
+{
+    WorkerArgs *args = (WorkerArgs *)dummyArgs;
+    WorkerPool *pool = args->pool;
+    while (1)
+    {
+        pthread_barrier_wait(&pool->start);
+        if (pool->shutdown)
+        {
+            return NULL;
+        }
+        pool->deltas[args->index].value = relaxPoolShare(pool, args->index);
+        pthread_barrier_wait(&pool->done);
+    }
+}
+
+/**
+ * Relaxes one thread's share of the pool's current job, the job's rows being split as evenly as possible
+ * returns the largest absolute change made to any value
+ */
+double relaxPoolShare(WorkerPool *pool, int index)
+{
+    int start, count;
+    calculateAllocation(pool->row_end - pool->row_start, pool->thread_count, index, &start, &count);
+    return relaxRegion(pool->in_grid, pool->out_grid, pool->row_start + start, pool->row_start + start + count,
+                       pool->column_start, pool->column_end, pool->bounds);
+}
+
+/**
+ * Same as relaxRegion, but with the rows split between the threads of the worker pool (when there is one)
+ * each thread's largest change is combined here, so only a single value per process goes on to the MPI reduction
+ */
+double relaxRegionParallel(Grid *in_grid, Grid *out_grid, int row_start, int row_end, int column_start, int column_end, const int bounds[4])
+{
+    WorkerPool *pool = workerPool;
+    if (pool == NULL)
+    {
+        return relaxRegion(in_grid, out_grid, row_start, row_end, column_start, column_end, bounds);
+    }
+
+    // clip the rows first so the threads split only the rows that will be relaxed
+    pool->in_grid = in_grid;
+    pool->out_grid = out_grid;
+    pool->row_start = row_start > bounds[0] ? row_start : bounds[0];
+    pool->row_end = row_end < bounds[1] ? row_end : bounds[1];
+    pool->row_end = pool->row_end > pool->row_start ? pool->row_end : pool->row_start;
+    pool->column_start = column_start;
+    pool->column_end = column_end;
+    pool->bounds = bounds;
+
+    pthread_barrier_wait(&pool->start);
+    double max_delta = relaxPoolShare(pool, 0);
+    pthread_barrier_wait(&pool->done);
+
+    for (int i = 1; i < pool->thread_count; i++)
+    {
+        if (pool->deltas[i].value > max_delta)
+        {
+            max_delta = pool->deltas[i].value;
+        }
+    }
+    return max_delta;
+}
+
+/**
+ * Works out the number of threads per process for -n auto: the node's processors shared between the processes on it
+ */
+int threadsPerProcess(void)
+{
+    MPI_Comm node;
+    int node_size;
+    MPI_CHECK(MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node));
+    MPI_CHECK(MPI_Comm_size(node, &node_size));
+    MPI_CHECK(MPI_Comm_free(&node));
+
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN) / node_size;
+    return threads > 1 ? threads : 1;
+}
+
+/**
+ * Relaxes the rows row_start to row_end and columns column_start to column_end (both exclusive) of a grid,
+ * clipped to bounds (first row, end row, first column, end column) so that fixed values are left alone
+ * returns the largest absolute change made to any value
+ */
+double relaxRegion(Grid *in_grid, Grid *out_grid, int row_start, int row_end, int column_start, int column_end, const int bounds[4])
+{
+    row_start = row_start > bounds[0] ? row_start : bounds[0];
+    row_end = row_end < bounds[1] ? row_end : bounds[1];
+    column_start = column_start > bounds[2] ? column_start : bounds[2];
+    column_end = column_end < bounds[3] ? column_end : bounds[3];
+
+    double max_delta = 0;
+    if (column_start >= column_end)
+    {
+        return max_delta;
+    }
+
+    // the row kernel relaxes from its second value, so hand it each row starting one before column_start
+    int offset = column_start - 1;
+    for (int s = row_start; s < row_end; s++)
+    {
+        double row_delta = relaxRow(GRID_ROW(in_grid, s - 1) + offset, GRID_ROW(in_grid, s) + offset, GRID_ROW(in_grid, s + 1) + offset,
+                                    GRID_ROW(out_grid, s) + offset, column_end - column_start + 2);
+        if (row_delta > max_delta)
+        {
+            max_delta = row_delta;
+        }
+    }
+    return max_delta;
+}
+
+/**
+ * Function that performs relaxation on all the values in a row, when provided with the rows above and below
+ * this is used for the edges of a process's allocation
+ * returns the largest absolute change made to any value in the row
+ */
+double relaxEdge(double *in_edge, double *neighbours_above, double *neighbours_below, double *out_edge, int columns)
+{
+    return relaxRow(neighbours_above, in_edge, neighbours_below, out_edge, columns);
+}
+
+/**
+ * Function that performs relaxation on all values in a grid that are not on the edge for the given number of rows
+ * the rows are shared between the worker pool's threads when there is one
+ * returns the largest absolute change made to any value
+ */
+double relaxGrid(Grid *in_grid, Grid *out_grid, int start_row, int rows)
+{
+    int bounds[4] = {start_row, start_row + rows, 1, in_grid->columns - 1};
+    return relaxRegionParallel(in_grid, out_grid, start_row, start_row + rows, 1, in_grid->columns - 1, bounds);
+}
+
+/**
+ * Sets up persistent requests for the single row halo exchange, one set for each of the two grids, as the
+ * grids swap every iteration and a persistent request is bound to its buffer
+ * with partitions > 0, MPI-4 partitioned requests are used, splitting each row into that many partitions
+ */
+void initRowHalo(RowHalo *halo, Grid *in_grid, Grid *out_grid, double *top_edge_neighbours, double *bottom_edge_neighbours,
+                 int partitions, int rank, int size)
+{
+    Grid *grids[2] = {in_grid, out_grid};
+    int columns = in_grid->columns;
+    halo->partitions = partitions;
+
+    for (int g = 0; g < 2; g++)
+    {
+        MPI_Request *requests = halo->requests[g];
+        halo->slabs[g] = grids[g]->data;
+        for (int i = 0; i < 4; i++)
+        {
+            requests[i] = MPI_REQUEST_NULL;
+        }
+
+        double *top_edge = GRID_ROW(grids[g], 0);
+        double *bottom_edge = GRID_ROW(grids[g], grids[g]->rows - 1);
+#if MPI_VERSION >= 4
+        if (partitions > 0)
+        {
+            int count = columns / partitions;
+            if (rank != 0)
+            {
+                MPI_CHECK(MPI_Precv_init(top_edge_neighbours, partitions, count, MPI_DOUBLE, rank - 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, MPI_INFO_NULL, &requests[HALO_RECV_TOP]));
+                MPI_CHECK(MPI_Psend_init(top_edge, partitions, count, MPI_DOUBLE, rank - 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, MPI_INFO_NULL, &requests[HALO_SEND_TOP]));
+            }
+            if (rank != size - 1)
+            {
+                MPI_CHECK(MPI_Precv_init(bottom_edge_neighbours, partitions, count, MPI_DOUBLE, rank + 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, MPI_INFO_NULL, &requests[HALO_RECV_BOTTOM]));
+                MPI_CHECK(MPI_Psend_init(bottom_edge, partitions, count, MPI_DOUBLE, rank + 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, MPI_INFO_NULL, &requests[HALO_SEND_BOTTOM]));
+            }
+            continue;
+        }
+#endif
+        // if not the first process (first process has no neighbour above)
+        // receive top edge neighbours and send the top edge of the allocation
+        if (rank != 0)
+        {
+            MPI_CHECK(MPI_Recv_init(top_edge_neighbours, columns, MPI_DOUBLE, rank - 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, &requests[HALO_RECV_TOP]));
+            MPI_CHECK(MPI_Send_init(top_edge, columns, MPI_DOUBLE, rank - 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, &requests[HALO_SEND_TOP]));
+        }
+        // if not the final process (final process has no neighbour below)
+        // receive bottom edge neighbours and send bottom edge of the allocation
+        if (rank != size - 1)
+        {
+            MPI_CHECK(MPI_Recv_init(bottom_edge_neighbours, columns, MPI_DOUBLE, rank + 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, &requests[HALO_RECV_BOTTOM]));
+            MPI_CHECK(MPI_Send_init(bottom_edge, columns, MPI_DOUBLE, rank + 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, &requests[HALO_SEND_BOTTOM]));
+        }
+    }
+}
+
+/**
+ * Starts the halo exchange for the grid currently being relaxed from
+ * returns its requests, indexed by HALO_RECV_TOP etc. (MPI_REQUEST_NULL where there is no neighbour, so waiting returns at once)
+ */
+MPI_Request *startRowHalo(RowHalo *halo, Grid *in_grid)
+{
+    MPI_Request *requests = halo->requests[in_grid->data == halo->slabs[0] ? 0 : 1];
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (requests[i] != MPI_REQUEST_NULL)
+        {
+            MPI_CHECK(MPI_Start(&requests[i]));
+        }
+    }
+#if MPI_VERSION >= 4
+    // the edges were finished last iteration, so every partition is ready to go as soon as the sends start
+    if (halo->partitions > 0)
+    {
+        for (int i = HALO_SEND_TOP; i <= HALO_SEND_BOTTOM; i++)
+        {
+            if (requests[i] != MPI_REQUEST_NULL)
+            {
+                MPI_CHECK(MPI_Pready_range(0, halo->partitions - 1, requests[i]));
+            }
+        }
+    }
+#endif
+    return requests;
+}
+
+/**
+ * Releases the persistent requests of a halo exchange
+ */
+void freeRowHalo(RowHalo *halo)
+{
+    for (int g = 0; g < 2; g++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (halo->requests[g][i] != MPI_REQUEST_NULL)
+            {
+                MPI_CHECK(MPI_Request_free(&halo->requests[g][i]));
+            }
+        }
+    }
+}
+
+/**
+ * Sends depth rows from each end of the process's allocation to its neighbours and receives theirs into in_grid's ghost rows
+ * the fixed first and last column of each ghost row are then copied into out_grid, as relaxation never writes them
+ */
+void exchangeHalo(Grid *in_grid, Grid *out_grid, int depth, int rank, int size)
+{
+    MPI_Request requests[4];
+    int count = 0;
+
+    // depth consecutive rows, skipping the padding at the end of each
+    MPI_Datatype rows_type;
+    MPI_CHECK(MPI_Type_vector(depth, in_grid->columns, in_grid->stride, MPI_DOUBLE, &rows_type));
+    MPI_CHECK(MPI_Type_commit(&rows_type));
+
+    if (rank != 0)
+    {
+        MPI_CHECK(MPI_Irecv(GRID_ROW(in_grid, -depth), 1, rows_type, rank - 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, &requests[count++]));
+        MPI_CHECK(MPI_Isend(GRID_ROW(in_grid, 0), 1, rows_type, rank - 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, &requests[count++]));
+    }
+    if (rank != size - 1)
+    {
+        MPI_CHECK(MPI_Irecv(GRID_ROW(in_grid, in_grid->rows), 1, rows_type, rank + 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, &requests[count++]));
+        MPI_CHECK(MPI_Isend(GRID_ROW(in_grid, in_grid->rows - depth), 1, rows_type, rank + 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, &requests[count++]));
+    }
+    MPI_CHECK(MPI_Waitall(count, requests, MPI_STATUSES_IGNORE));
+    MPI_CHECK(MPI_Type_free(&rows_type));
+
+    for (int g = 0; g < depth; g++)
+    {
+        int ghost_rows[2] = {-1 - g, in_grid->rows + g};
+        for (int i = 0; i < 2; i++)
+        {
+            GRID_ROW(out_grid, ghost_rows[i])[0] = GRID_ROW(in_grid, ghost_rows[i])[0];
+            GRID_ROW(out_grid, ghost_rows[i])[in_grid->columns - 1] = GRID_ROW(in_grid, ghost_rows[i])[in_grid->columns - 1];
+        }
+    }
+}
+
+/**
+ * Performs depth relaxation iterations using the ghost rows received by exchangeHalo, without any further communication
+ * each iteration relaxes one fewer ghost row at either end, so after depth iterations the process's own rows are exact
+ *
+ * The grid is worked through in column tiles sized to fit TILE_CACHE_BYTES, and within a tile every iteration trails the
+ * one before it by a row (and each tile by a column), so the few rows being worked on stay in cache across all depth iterations.
+ * Iterations alternate between the two grids, this skew guarantees a value is only overwritten once nothing still needs it.
+ * Returns the largest change made to the process's own rows by the final iteration, whose values are left in out_grid
+ */
+double relaxTemporalBlock(Grid *in_grid, Grid *out_grid, int depth, int has_top, int has_bottom)
+{
+    Grid *grids[2] = {in_grid, out_grid};
+    int rows = in_grid->rows;
+    int columns = in_grid->columns;
+    double max_delta = 0;
+
+    int tile_columns = TILE_CACHE_BYTES / (2 * (depth + 2) * (int)sizeof(double));
+    if (tile_columns < 2 * depth)
+    {
+        tile_columns = 2 * depth;
+    }
+
+    for (int tile_start = 1; tile_start < columns - 1; tile_start += tile_columns)
+    {
+        int last_tile = tile_start + tile_columns >= columns - 1;
+
+        // the wavefront position is the row the first iteration is on, iteration t is t - 1 rows behind it
+        for (int front = has_top ? 1 - depth : 1; front < rows + depth + depth; front++)
+        {
+            for (int t = 1; t <= depth; t++)
+            {
+                int row = front - (t - 1);
+                int first_row = has_top ? t - depth : 1;
+                int end_row = has_bottom ? rows + depth - t : rows - 1;
+                if (row < first_row || row >= end_row)
+                {
+                    continue;
+                }
+
+                // iteration t's part of the tile is shifted t - 1 columns left, clipped to the interior of the grid
+                int first_column = tile_start - (t - 1);
+                int end_column = last_tile ? columns - 1 : tile_start + tile_columns - (t - 1);
+                first_column = first_column < 1 ? 1 : first_column;
+                end_column = end_column < 1 ? 1 : end_column;
+                if (first_column >= end_column)
+                {
+                    continue;
+                }
+
+                Grid *from = grids[(t - 1) % 2];
+                Grid *to = grids[t % 2];
+                int offset = first_column - 1;
+                double row_delta = relaxRow(GRID_ROW(from, row - 1) + offset, GRID_ROW(from, row) + offset, GRID_ROW(from, row + 1) + offset,
+                                            GRID_ROW(to, row) + offset, end_column - first_column + 2);
+
+                if (t == depth && row >= 0 && row < rows && row_delta > max_delta)
+                {
+                    max_delta = row_delta;
+                }
+            }
+        }
+    }
+
+    // iterations alternate between the grids, so an even depth leaves the newest values in in_grid
+    if (depth % 2 == 0)
+    {
+        swapGrids(in_grid, out_grid);
+    }
+    return max_delta;
+}
+
+/**
+ * Relaxes the grid until complete, exchanging depth ghost rows with each neighbour and then performing depth iterations per exchange
+ * completeness is only checked at the end of each block (or less often, depending on the check policy),
+ * so up to depth - 1 more iterations may be done than with a single row halo
+ * returns the number of iterations performed, the final values are left in out_grid
+ */
+int relaxTemporalBlocking(Grid *in_grid, Grid *out_grid, int depth, double precision, ConvergenceCheck *check, int rank, int size)
+{
+    int finished = 0;
+    int iterations = 0;
+
+    while (!finished)
+    {
+        exchangeHalo(in_grid, out_grid, depth, rank, size);
+
+        double max_delta = relaxTemporalBlock(in_grid, out_grid, depth, rank != 0, rank != size - 1);
+        iterations += depth;
+
+        // the previous block's values are no longer held once a block is done, so a late result from an
+        // overlapped check finishes on this block instead, which is at least as close to the solution
+        finished = checkConvergence(check, max_delta, iterations, precision) != CHECK_CONTINUE;
+        if (!finished)
+        {
+            swapGrids(in_grid, out_grid);
+        }
+    }
+    return iterations;
+}
+
+/**
+ * Sets up the solver method from a -s arguement: jacobi, gs (red-black Gauss-Seidel), sor[:<omega>], multigrid
+ * or cg[:none|jacobi|block] (conjugate gradients with the given preconditioner)
+ * returns 0 on success, -1 if the arguement is not recognised
+ */
+int parseMethod(const char *arg, SolverOptions *options)
+{
+    options->omega = 1.0;
+    options->preconditioner = PRECONDITIONER_NONE;
+    if (strcmp(arg, "jacobi") == 0)
+    {
+        options->method = METHOD_JACOBI;
+    }
+    else if (strcmp(arg, "gs") == 0)
+    {
+        options->method = METHOD_RED_BLACK;
+    }
+    else if (strcmp(arg, "sor") == 0)
+    {
+        // estimated from the dimension once it is known
+        options->method = METHOD_RED_BLACK;
+        options->omega = 0;
+    }
+    else if (strcmp(arg, "multigrid") == 0)
+    {
+        options->method = METHOD_MULTIGRID;
+    }
+    else if (strcmp(arg, "cg") == 0 || strcmp(arg, "cg:none") == 0)
+    {
+        options->method = METHOD_CG;
+    }
+    else if (strcmp(arg, "cg:jacobi") == 0)
+    {
+        options->method = METHOD_CG;
+        options->preconditioner = PRECONDITIONER_JACOBI;
+    }
+    else if (strcmp(arg, "cg:block") == 0)
+    {
+        options->method = METHOD_CG;
+        options->preconditioner = PRECONDITIONER_BLOCK_JACOBI;
+    }
+    else if (sscanf(arg, "sor:%lf", &options->omega) == 1 && options->omega > 0 && options->omega < 2)
+    {
+        options->method = METHOD_RED_BLACK;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * The over-relaxation factor that minimises the iterations SOR needs for the 5 point Laplacian on a dimension x dimension grid
+ * derived from the spectral radius of Jacobi iteration on it, cos(pi / (dimension - 1))
+ */
+double optimalOmega(int dimension)
+{
+    return 2.0 / (1.0 + sin(M_PI / (dimension - 1)));
+}
+
+/**
+ * Sets up persistent requests exchanging a process's first and last rows with the processes above and below,
+ * receiving theirs into the given ghost rows, for rows of count values of the given type
+ */
+void initRowExchange(void *first_row, void *last_row, void *ghost_above, void *ghost_below, int count, MPI_Datatype type,
+                     MPI_Request requests[4], MPI_Comm comm, int rank, int size)
+{
+    // processes at the top and bottom of the grid have MPI_PROC_NULL neighbours, so those requests do nothing
+    int above = rank != 0 ? rank - 1 : MPI_PROC_NULL;
+    int below = rank != size - 1 ? rank + 1 : MPI_PROC_NULL;
+
+    MPI_CHECK(MPI_Recv_init(ghost_above, count, type, above, SEND_BOTTOM_EDGE_TAG, comm, &requests[0]));
+    MPI_CHECK(MPI_Recv_init(ghost_below, count, type, below, SEND_TOP_EDGE_TAG, comm, &requests[1]));
+    MPI_CHECK(MPI_Send_init(first_row, count, type, above, SEND_TOP_EDGE_TAG, comm, &requests[2]));
+    MPI_CHECK(MPI_Send_init(last_row, count, type, below, SEND_BOTTOM_EDGE_TAG, comm, &requests[3]));
+}
+
+/**
+ * Function that allocates memory for a single precision grid of the specified dimensions, with a ghost row above and below
+ * laid out the same way as allocateGridMem's grids
+ */
+FloatGrid allocateFloatGridMem(int rows, int columns)
+{
+    const int values_per_unit = GRID_ALIGNMENT / sizeof(float);
+
+    FloatGrid grid;
+    grid.rows = rows;
+    grid.columns = columns;
+    grid.stride = (columns + values_per_unit - 1) / values_per_unit * values_per_unit;
+
+    size_t bytes = sizeof(float) * (size_t)grid.stride * (size_t)(rows + 2);
+    if (posix_memalign((void **)&grid.base, GRID_ALIGNMENT, bytes) != 0)
+    {
+        fprintf(stderr, "allocateFloatGridMem: unable to allocate %zu bytes\n", bytes);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    grid.data = grid.base + grid.stride;
+    return grid;
+}
+
+/**
+ * Relaxes a process's rows of the grid in single precision, which halves the memory traffic and the size of the
+ * halo messages and doubles the values per vector instruction, until the largest change falls to the precision or
+ * to MIXED_SWITCH_ULPS single precision units of the grid's largest value, below which single precision stalls,
+ * or until the largest change stops falling from one MIXED_STALL_WINDOW iterations to the next, as it can stall sooner
+ * the interior values are then written back to grid, for double precision iterations to finish off, the edges are left exact
+ * returns the number of iterations performed
+ */
+int relaxSinglePrecision(Grid *grid, ConvergenceCheck check, double precision, int rank, int size)
+{
+    int rows = grid->rows;
+    int columns = grid->columns;
+
+    double local_largest = 0;
+    FloatGrid grids[2] = {allocateFloatGridMem(rows, columns), allocateFloatGridMem(rows, columns)};
+    for (int s = 0; s < rows; s++)
+    {
+        const double *row = GRID_ROW(grid, s);
+        for (int x = 0; x < columns; x++)
+        {
+            GRID_ROW(&grids[0], s)[x] = (float)row[x];
+            GRID_ROW(&grids[1], s)[x] = (float)row[x];
+            local_largest = fmax(local_largest, fabs(row[x]));
+        }
+    }
+    double largest;
+    MPI_CHECK(MPI_Allreduce(&local_largest, &largest, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD));
+    double switch_delta = fmax(precision, MIXED_SWITCH_ULPS * FLT_EPSILON * largest);
+
+    // each grid's rows are exchanged from its own set of requests, as the grids swap roles every iteration
+    MPI_Request requests[2][4];
+    for (int i = 0; i < 2; i++)
+    {
+        initRowExchange(GRID_ROW(&grids[i], 0), GRID_ROW(&grids[i], rows - 1), GRID_ROW(&grids[i], -1), GRID_ROW(&grids[i], rows),
+                        columns, MPI_FLOAT, requests[i], MPI_COMM_WORLD, rank, size);
+    }
+
+    int first_row = rank == 0 ? 1 : 0;
+    int end_row = rank == size - 1 ? rows - 1 : rows;
+
+    int current = 0;
+    int finished = 0;
+    int stalled = 0;
+    int iterations = 0;
+    double window_delta = HUGE_VAL; // overall largest change at the end of the previous stall window
+    while (!finished)
+    {
+        FloatGrid *in_grid = &grids[current];
+        FloatGrid *out_grid = &grids[current ^ 1];
+        MPI_CHECK(MPI_Startall(4, requests[current]));
+        MPI_CHECK(MPI_Waitall(4, requests[current], MPI_STATUSES_IGNORE));
+
+        float max_delta = 0;
+        for (int s = first_row; s < end_row; s++)
+        {
+            max_delta = fmaxf(max_delta, relaxRowFloat(GRID_ROW(in_grid, s - 1), GRID_ROW(in_grid, s), GRID_ROW(in_grid, s + 1),
+                                                       GRID_ROW(out_grid, s), columns));
+        }
+        iterations++;
+        current ^= 1;
+
+        // the double precision iterations confirm the result, so stopping one iteration late on an overlapped check does no harm
+        finished = checkConvergence(&check, max_delta, iterations, switch_delta) != CHECK_CONTINUE;
+
+        if (!finished && iterations % MIXED_STALL_WINDOW == 0)
+        {
+            double global_delta;
+            double local_delta = max_delta;
+            MPI_CHECK(MPI_Allreduce(&local_delta, &global_delta, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD));
+            stalled = finished = global_delta >= window_delta;
+            window_delta = global_delta;
+        }
+    }
+    // leaving on a stall can leave an overlapped check's reduction in flight
+    if (check.pending)
+    {
+        MPI_CHECK(MPI_Wait(&check.request, MPI_STATUS_IGNORE));
+    }
+
+    for (int s = first_row; s < end_row; s++)
+    {
+        const float *row = GRID_ROW(&grids[current], s);
+        double *out = GRID_ROW(grid, s);
+        for (int x = 1; x < columns - 1; x++)
+        {
+            out[x] = row[x];
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            MPI_CHECK(MPI_Request_free(&requests[i][j]));
+        }
+        free(grids[i].base);
+    }
+
+    if (rank == 0)
+    {
+        printf("Switching to double precision after %d single precision iterations%s\n", iterations,
+               stalled ? " (single precision stopped improving)" : "");
+    }
+    return iterations;
+}
+
+/**
+ * Sets up persistent requests exchanging a grid's first and last rows with the processes above and below,
+ * receiving theirs into the grid's ghost rows (the grid is updated in place, so its buffers never change)
+ */
+void initGhostRowExchange(Grid *grid, MPI_Request requests[4], MPI_Comm comm, int rank, int size)
+{
+    initRowExchange(GRID_ROW(grid, 0), GRID_ROW(grid, grid->rows - 1), GRID_ROW(grid, -1), GRID_ROW(grid, grid->rows),
+                    grid->columns, MPI_DOUBLE, requests, comm, rank, size);
+}
+
+/**
+ * Relaxes the cells of one colour in the given rows of a grid in place, a cell's colour being the parity of its overall row plus column
+ * each cell only depends on cells of the other colour, so the order they are updated in makes no difference
+ * with omega other than 1 each cell moves omega times as far as the average of its neighbours would take it (over-relaxation)
+ * returns the largest absolute change made to any value
+ */
+double relaxColour(Grid *grid, int row_start, int row_end, int first_row_global, int colour, double omega)
+{
+    double max_delta = 0;
+    for (int s = row_start; s < row_end; s++)
+    {
+        const double *above = GRID_ROW(grid, s - 1);
+        const double *below = GRID_ROW(grid, s + 1);
+        double *row = GRID_ROW(grid, s);
+
+        // the first interior column of this row with the right colour
+        int first = 1 + ((first_row_global + s + 1 + colour) & 1);
+        for (int x = first; x < grid->columns - 1; x += 2)
+        {
+            double average = (above[x] + below[x] + row[x - 1] + row[x + 1]) * 0.25;
+            double value = omega == 1.0 ? average : row[x] + omega * (average - row[x]);
+            double delta = fabs(value - row[x]);
+            row[x] = value;
+            if (delta > max_delta)
+            {
+                max_delta = delta;
+            }
+        }
+    }
+    return max_delta;
+}
+
+/**
+ * Relaxes the grid split between processes by rows using red-black Gauss-Seidel, or SOR when omega is not 1
+ * the grid is updated in place, so only one grid is held, and ghost rows are exchanged before each half sweep
+ * returns the number of iterations performed, with this process's rows of the final grid in result
+ */
+int relaxRedBlack(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size)
+{
+    int dimension = options->dimension;
+    double omega = options->omega > 0 ? options->omega : optimalOmega(dimension);
+    if (rank == 0)
+    {
+        printf("Using red-black %s with omega %f\n", omega == 1.0 ? "Gauss-Seidel" : "SOR", omega);
+    }
+
+    calculateAllocation(dimension, size, rank, &layout->row_start, &layout->rows);
+    layout->column_start = 0;
+    layout->columns = dimension;
+    int rows = layout->rows;
+
+    Grid grid = loadGrid(options, layout, 1, 0);
+
+    MPI_Request requests[4];
+    initGhostRowExchange(&grid, requests, MPI_COMM_WORLD, rank, size);
+
+    // the overall top and bottom rows are fixed
+    int first_row = rank == 0 ? 1 : 0;
+    int end_row = rank == size - 1 ? rows - 1 : rows;
+
+    int finished = 0;
+    int iterations = 0;
+    while (!finished)
+    {
+        double max_delta = 0;
+
+        // the red cells need the neighbours' black cells and the black cells the neighbours' new red cells,
+        // so the ghost rows are refreshed before each half sweep
+        for (int colour = 0; colour < 2; colour++)
+        {
+            MPI_CHECK(MPI_Startall(4, requests));
+            MPI_CHECK(MPI_Waitall(4, requests, MPI_STATUSES_IGNORE));
+            max_delta = fmax(max_delta, relaxColour(&grid, first_row, end_row, layout->row_start, colour, omega));
+        }
+        iterations++;
+
+        // values are updated in place, so an overlapped check confirming the previous iteration finishes on this one instead,
+        // which is at least as close to the solution
+        finished = checkConvergence(&options->check, max_delta, iterations, options->precision) != CHECK_CONTINUE;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        MPI_CHECK(MPI_Request_free(&requests[i]));
+    }
+
+    *result = grid;
+    return iterations;
+}
+
+/**
+ * Zeroes every value held by a grid, including its ghost rows and columns
+ */
+void clearGrid(Grid *grid)
+{
+    size_t rows = (size_t)(grid->rows + 2 * grid->halo);
+    memset(grid->base, 0, sizeof(double) * (size_t)grid->stride * (rows > 0 ? rows : 1));
+}
+
+/**
+ * Builds the hierarchy of grids for multigrid over the given process's rows of a dimension x dimension grid
+ * finest is used as the finest level's solution, or (if NULL) a zeroed one is allocated
+ * each coarser level takes every other row and column plus the far edges, which are left a short spacing from the last
+ * row and column before them when dimension - 1 is odd (edge_fraction being that of the finest level)
+ * coarsening stops at MULTIGRID_COARSEST_DIMENSION, or once a process would hold fewer than MULTIGRID_MIN_ROWS rows,
+ * in which case the coarsest level is gathered onto the first process and solved there with a hierarchy of its own
+ */
+Multigrid *createMultigrid(Grid *finest, int dimension, double edge_fraction, int row_start, int rows, MPI_Comm comm)
+{
+    Multigrid *multigrid = calloc(1, sizeof(Multigrid));
+    multigrid->comm = comm;
+    MPI_CHECK(MPI_Comm_rank(comm, &multigrid->rank));
+    MPI_CHECK(MPI_Comm_size(comm, &multigrid->size));
+    multigrid->levels = malloc(sizeof(MultigridLevel) * MULTIGRID_MAX_LEVELS);
+
+    while (multigrid->depth < MULTIGRID_MAX_LEVELS)
+    {
+        MultigridLevel *level = &multigrid->levels[multigrid->depth++];
+        level->dimension = dimension;
+        level->row_start = row_start;
+        level->edge_fraction = edge_fraction;
+        if (multigrid->depth == 1 && finest != NULL)
+        {
+            level->u = *finest;
+        }
+        else
+        {
+            level->u = allocateGridMem(rows, dimension, 1, 0);
+            clearGrid(&level->u);
+        }
+        level->f = allocateGridMem(rows, dimension, 0, 0);
+        level->r = allocateGridMem(rows, dimension, 1, 0);
+        level->scratch = allocateGridMem(rows, dimension, 0, 0);
+        clearGrid(&level->f);
+        clearGrid(&level->r);
+        initGhostRowExchange(&level->u, level->u_halo, comm, multigrid->rank, multigrid->size);
+        initGhostRowExchange(&level->r, level->r_halo, comm, multigrid->rank, multigrid->size);
+
+        if (dimension <= MULTIGRID_COARSEST_DIMENSION)
+        {
+            break;
+        }
+
+        // coarse row i sits on fine row 2i apart from the far edge, which stays on the fine far edge,
+        // so each process keeps the coarse rows whose fine rows it holds
+        int coarse_dimension = dimension / 2 + 1;
+        int coarse_start = (row_start + 1) / 2;
+        int coarse_end = row_start + rows == dimension ? coarse_dimension : (row_start + rows + 1) / 2;
+
+        int fewest_rows;
+        int coarse_rows = coarse_end - coarse_start;
+        MPI_CHECK(MPI_Allreduce(&coarse_rows, &fewest_rows, 1, MPI_INT, MPI_MIN, comm));
+        if (multigrid->size > 1 && fewest_rows < MULTIGRID_MIN_ROWS)
+        {
+            break;
+        }
+        // the last coarse spacing is the fine one from row 2i to the edge, plus a whole fine spacing if dimension is odd
+        edge_fraction = dimension % 2 == 0 ? edge_fraction / 2 : (1 + edge_fraction) / 2;
+        dimension = coarse_dimension;
+        row_start = coarse_start;
+        rows = coarse_rows;
+    }
+
+    if (multigrid->size > 1)
+    {
+        MultigridLevel *coarsest = &multigrid->levels[multigrid->depth - 1];
+        MPI_CHECK(MPI_Type_vector(coarsest->u.rows, coarsest->dimension, coarsest->u.stride, MPI_DOUBLE, &multigrid->block_type));
+        MPI_CHECK(MPI_Type_commit(&multigrid->block_type));
+
+        if (multigrid->rank == 0)
+        {
+            multigrid->counts = malloc(sizeof(int) * multigrid->size);
+            multigrid->displacements = malloc(sizeof(int) * multigrid->size);
+        }
+        int values = coarsest->u.rows * coarsest->dimension;
+        MPI_CHECK(MPI_Gather(&values, 1, MPI_INT, multigrid->counts, 1, MPI_INT, 0, comm));
+        if (multigrid->rank == 0)
+        {
+            multigrid->displacements[0] = 0;
+            for (int i = 1; i < multigrid->size; i++)
+            {
+                multigrid->displacements[i] = multigrid->displacements[i - 1] + multigrid->counts[i - 1];
+            }
+            multigrid->gathered = createMultigrid(NULL, coarsest->dimension, coarsest->edge_fraction, 0, coarsest->dimension, MPI_COMM_SELF);
+            multigrid->gather_buffer = malloc(sizeof(double) * coarsest->dimension * coarsest->dimension);
+        }
+    }
+    return multigrid;
+}
+
+/**
+ * Releases everything held by a multigrid hierarchy, apart from the finest level's solution
+ */
+void destroyMultigrid(Multigrid *multigrid)
+{
+    for (int i = 0; i < multigrid->depth; i++)
+    {
+        MultigridLevel *level = &multigrid->levels[i];
+        for (int j = 0; j < 4; j++)
+        {
+            MPI_CHECK(MPI_Request_free(&level->u_halo[j]));
+            MPI_CHECK(MPI_Request_free(&level->r_halo[j]));
+        }
+        if (i > 0)
+        {
+            freeGridMem(&level->u);
+        }
+        freeGridMem(&level->f);
+        freeGridMem(&level->r);
+        freeGridMem(&level->scratch);
+    }
+    if (multigrid->size > 1)
+    {
+        MPI_CHECK(MPI_Type_free(&multigrid->block_type));
+    }
+    if (multigrid->gathered != NULL)
+    {
+        freeGridMem(&multigrid->gathered->levels[0].u);
+        destroyMultigrid(multigrid->gathered);
+    }
+    free(multigrid->gather_buffer);
+    free(multigrid->counts);
+    free(multigrid->displacements);
+    free(multigrid->levels);
+    free(multigrid);
+}
+
+/**
+ * Works out which of a process's rows (of a dimension x dimension grid) are not on the fixed top and bottom edges
+ */
+static void interiorRows(int row_start, int rows, int dimension, int *first_row, int *end_row)
+{
+    *first_row = row_start == 0 ? 1 : 0;
+    *end_row = row_start + rows == dimension ? rows - 1 : rows;
+}
+
+/**
+ * Gives a level's stencil weights in one direction at overall index i, towards index i - 1 and i + 1
+ * they are 1 apart from beside a far edge a short spacing away, where they come from the second difference over
+ * the unequal spacings either side
+ */
+static void stencilWeights(const MultigridLevel *level, int i, double *previous, double *next)
+{
+    double fraction = level->edge_fraction;
+    *previous = 1;
+    *next = 1;
+    if (i == level->dimension - 2 && fraction < 1)
+    {
+        *previous = 2 / (1 + fraction);
+        *next = 2 / (fraction * (1 + fraction));
+    }
+}
+
+/**
+ * Gives the sum of a level's stencil weights in one direction at overall index i, 2 away from a short spacing
+ */
+static double stencilDiagonal(const MultigridLevel *level, int i)
+{
+    double previous, next;
+    stencilWeights(level, i, &previous, &next);
+    return previous + next;
+}
+
+/**
+ * Replaces the plain neighbour averages relaxGrid left in a level's scratch with weighted ones, for the values beside
+ * far edges a short spacing away (the last row and column before them)
+ */
+static void weightEdgeAverages(MultigridLevel *level, int first_row, int end_row)
+{
+    if (level->edge_fraction >= 1)
+    {
+        return;
+    }
+    int last = level->dimension - 2;
+    double left_weight, right_weight;
+    stencilWeights(level, last, &left_weight, &right_weight);
+
+    for (int s = first_row; s < end_row; s++)
+    {
+        int y = level->row_start + s;
+        const double *above = GRID_ROW(&level->u, s - 1);
+        const double *row = GRID_ROW(&level->u, s);
+        const double *below = GRID_ROW(&level->u, s + 1);
+        double *average = GRID_ROW(&level->scratch, s);
+        double up_weight, down_weight;
+        stencilWeights(level, y, &up_weight, &down_weight);
+
+        // the whole last row, or just the last column of the others
+        for (int x = y == last ? 1 : last; x <= last; x++)
+        {
+            double previous = x == last ? left_weight : 1;
+            double next = x == last ? right_weight : 1;
+            average[x] = (up_weight * above[x] + down_weight * below[x] + previous * row[x - 1] + next * row[x + 1]) /
+                         (up_weight + down_weight + previous + next);
+        }
+    }
+}
+
+/**
+ * Performs sweeps of weighted Jacobi relaxation on a level, using relaxGrid for the neighbour averages
+ * the right hand side is added in and each value moved MULTIGRID_WEIGHT of the way, which damps the oscillating
+ * errors that plain Jacobi leaves alone
+ */
+void smoothLevel(MultigridLevel *level, int sweeps)
+{
+    int first_row, end_row;
+    interiorRows(level->row_start, level->u.rows, level->dimension, &first_row, &end_row);
+    int last = level->dimension - 2;
+    double last_diagonal = stencilDiagonal(level, last);
+
+    for (int i = 0; i < sweeps; i++)
+    {
+        MPI_CHECK(MPI_Startall(4, level->u_halo));
+        MPI_CHECK(MPI_Waitall(4, level->u_halo, MPI_STATUSES_IGNORE));
+        relaxGrid(&level->u, &level->scratch, first_row, end_row - first_row);
+        weightEdgeAverages(level, first_row, end_row);
+
+        for (int s = first_row; s < end_row; s++)
+        {
+            double *u = GRID_ROW(&level->u, s);
+            const double *average = GRID_ROW(&level->scratch, s);
+            const double *f = GRID_ROW(&level->f, s);
+            double row_diagonal = stencilDiagonal(level, level->row_start + s);
+            for (int x = 1; x <= last; x++)
+            {
+                double diagonal = row_diagonal + (x == last ? last_diagonal : 2);
+                u[x] += MULTIGRID_WEIGHT * (average[x] + f[x] / diagonal - u[x]);
+            }
+        }
+    }
+}
+
+/**
+ * Calculates the residual f - Au of a level, and fills in its ghost rows from the neighbouring processes
+ * returns the largest absolute value of the residual over 4 across all processes, which on the finest level (where f is 0)
+ * is the largest change another Jacobi iteration would make, so it can be compared against the same precision
+ * (or NaN if any of the residual is NaN, so a diverged solve is never taken for a converged one)
+ */
+double computeResidual(MultigridLevel *level)
+{
+    int first_row, end_row;
+    interiorRows(level->row_start, level->u.rows, level->dimension, &first_row, &end_row);
+
+    int last = level->dimension - 2;
+    double last_diagonal = stencilDiagonal(level, last);
+
+    MPI_CHECK(MPI_Startall(4, level->u_halo));
+    MPI_CHECK(MPI_Waitall(4, level->u_halo, MPI_STATUSES_IGNORE));
+    relaxGrid(&level->u, &level->scratch, first_row, end_row - first_row);
+    weightEdgeAverages(level, first_row, end_row);
+
+    double max_residual = 0;
+    for (int s = first_row; s < end_row; s++)
+    {
+        const double *u = GRID_ROW(&level->u, s);
+        const double *average = GRID_ROW(&level->scratch, s);
+        const double *f = GRID_ROW(&level->f, s);
+        double *r = GRID_ROW(&level->r, s);
+        double row_diagonal = stencilDiagonal(level, level->row_start + s);
+        for (int x = 1; x <= last; x++)
+        {
+            r[x] = f[x] + (row_diagonal + (x == last ? last_diagonal : 2)) * (average[x] - u[x]);
+            // unlike fmax, this keeps hold of a NaN once it has been seen
+            double magnitude = fabs(r[x]);
+            max_residual = magnitude > max_residual || magnitude != magnitude ? magnitude : max_residual;
+        }
+    }
+
+    MPI_CHECK(MPI_Startall(4, level->r_halo));
+    MPI_CHECK(MPI_Waitall(4, level->r_halo, MPI_STATUSES_IGNORE));
+    return max_residual * 0.25;
+}
+
+/**
+ * Gives the full weighting in one direction of the fine values at 2i - 1, 2i and 2i + 1 into coarse overall index i
+ * beside a far edge a short spacing away they follow the coarse value's interpolation weights there instead of 1/4, 1/2, 1/4
+ */
+static void restrictionWeights(const MultigridLevel *fine, const MultigridLevel *coarse, int i, double weights[3])
+{
+    weights[0] = 0.25;
+    weights[1] = 0.5;
+    weights[2] = 0.25;
+    if (i == coarse->dimension - 2 && coarse->edge_fraction < 1)
+    {
+        // fine 2i + 1 is either the far edge itself or a short fine spacing from it
+        double beyond = 2 * i + 1 == fine->dimension - 1 ? 0 : fine->edge_fraction / (1 + fine->edge_fraction);
+        double total = 1.5 + beyond;
+        weights[0] = 0.5 / total;
+        weights[1] = 1 / total;
+        weights[2] = beyond / total;
+    }
+}
+
+/**
+ * Transfers a level's residual to the coarser level's right hand side by full weighting,
+ * scaled by 4 as the coarse level's spacing is twice the fine level's, and clears the coarse level's correction
+ */
+void restrictResidual(MultigridLevel *fine, MultigridLevel *coarse)
+{
+    int first_row, end_row;
+    interiorRows(coarse->row_start, coarse->u.rows, coarse->dimension, &first_row, &end_row);
+    clearGrid(&coarse->u);
+
+    int last = coarse->dimension - 2;
+    double inner[3], edge[3];
+    restrictionWeights(fine, coarse, 1, inner);
+    restrictionWeights(fine, coarse, last, edge);
+
+    for (int t = first_row; t < end_row; t++)
+    {
+        // the fine row under this coarse row is always held by this process, the ones either side may be ghost rows
+        int s = 2 * (coarse->row_start + t) - fine->row_start;
+        const double *above = GRID_ROW(&fine->r, s - 1);
+        const double *row = GRID_ROW(&fine->r, s);
+        const double *below = GRID_ROW(&fine->r, s + 1);
+        double *f = GRID_ROW(&coarse->f, t);
+        double vertical[3];
+        restrictionWeights(fine, coarse, coarse->row_start + t, vertical);
+        for (int x = 1; x <= last; x++)
+        {
+            int X = 2 * x;
+            const double *horizontal = x == last ? edge : inner;
+            f[x] = 4 * (vertical[0] * (horizontal[0] * above[X - 1] + horizontal[1] * above[X] + horizontal[2] * above[X + 1]) +
+                        vertical[1] * (horizontal[0] * row[X - 1] + horizontal[1] * row[X] + horizontal[2] * row[X + 1]) +
+                        vertical[2] * (horizontal[0] * below[X - 1] + horizontal[1] * below[X] + horizontal[2] * below[X + 1]));
+        }
+    }
+}
+
+/**
+ * Gives the interpolation weights in one direction of coarse i / 2 and (i + 1) / 2 into fine overall index i,
+ * which are the same coarse index when i is even
+ * they are a half each apart from between the last coarse value and a far edge that is further away than a fine spacing
+ */
+static void prolongationWeights(const MultigridLevel *fine, int i, double weights[2])
+{
+    weights[0] = 0.5;
+    weights[1] = 0.5;
+    if (i == fine->dimension - 2 && i % 2 == 1 && fine->edge_fraction < 1)
+    {
+        weights[0] = fine->edge_fraction / (1 + fine->edge_fraction);
+        weights[1] = 1 / (1 + fine->edge_fraction);
+    }
+}
+
+/**
+ * Interpolates the coarser level's correction bilinearly and adds it to a level's values
+ */
+void prolongCorrection(MultigridLevel *coarse, MultigridLevel *fine)
+{
+    int first_row, end_row;
+    interiorRows(fine->row_start, fine->u.rows, fine->dimension, &first_row, &end_row);
+
+    // the coarse rows either side of a fine row may be held by the neighbouring processes
+    MPI_CHECK(MPI_Startall(4, coarse->u_halo));
+    MPI_CHECK(MPI_Waitall(4, coarse->u_halo, MPI_STATUSES_IGNORE));
+
+    int last = fine->dimension - 2;
+    double inner[2], edge[2];
+    prolongationWeights(fine, 1, inner);
+    prolongationWeights(fine, last, edge);
+
+    for (int s = first_row; s < end_row; s++)
+    {
+        int y = fine->row_start + s;
+        const double *upper = GRID_ROW(&coarse->u, y / 2 - coarse->row_start);
+        const double *lower = GRID_ROW(&coarse->u, (y + 1) / 2 - coarse->row_start);
+        double *u = GRID_ROW(&fine->u, s);
+        double vertical[2];
+        prolongationWeights(fine, y, vertical);
+        for (int x = 1; x <= last; x++)
+        {
+            int left = x / 2;
+            int right = (x + 1) / 2;
+            const double *horizontal = x == last ? edge : inner;
+            u[x] += vertical[0] * (horizontal[0] * upper[left] + horizontal[1] * upper[right]) +
+                    vertical[1] * (horizontal[0] * lower[left] + horizontal[1] * lower[right]);
+        }
+    }
+}
+
+/**
+ * Solves the coarsest level of a hierarchy, either by MULTIGRID_COARSEST_SWEEPS of smoothing or, when it is split between processes,
+ * by gathering it onto the first process and running V-cycles of that process's own hierarchy on it
+ */
+void solveCoarsest(Multigrid *multigrid)
+{
+    MultigridLevel *coarsest = &multigrid->levels[multigrid->depth - 1];
+    if (multigrid->size == 1)
+    {
+        smoothLevel(coarsest, MULTIGRID_COARSEST_SWEEPS);
+        return;
+    }
+
+    Multigrid *gathered = multigrid->gathered;
+    Grid *grids[2] = {&coarsest->u, &coarsest->f};
+    for (int i = 0; i < 2; i++)
+    {
+        MPI_CHECK(MPI_Gatherv(grids[i]->data, 1, multigrid->block_type, multigrid->gather_buffer, multigrid->counts,
+                              multigrid->displacements, MPI_DOUBLE, 0, multigrid->comm));
+        if (gathered != NULL)
+        {
+            Grid *to = i == 0 ? &gathered->levels[0].u : &gathered->levels[0].f;
+            for (int y = 0; y < coarsest->dimension; y++)
+            {
+                memcpy(GRID_ROW(to, y), multigrid->gather_buffer + (size_t)y * coarsest->dimension, sizeof(double) * coarsest->dimension);
+            }
+        }
+    }
+
+    if (gathered != NULL)
+    {
+        for (int i = 0; i < MULTIGRID_COARSE_CYCLES; i++)
+        {
+            vCycle(gathered, 0);
+        }
+        for (int y = 0; y < coarsest->dimension; y++)
+        {
+            memcpy(multigrid->gather_buffer + (size_t)y * coarsest->dimension, GRID_ROW(&gathered->levels[0].u, y), sizeof(double) * coarsest->dimension);
+        }
+    }
+    MPI_CHECK(MPI_Scatterv(multigrid->gather_buffer, multigrid->counts, multigrid->displacements, MPI_DOUBLE,
+                           coarsest->u.data, 1, multigrid->block_type, 0, multigrid->comm));
+}
+
+/**
+ * Performs a V-cycle from the given level down: smoothing, restricting the residual, correcting from the coarser level
+ * (recursively) and smoothing again
+ */
+void vCycle(Multigrid *multigrid, int index)
+{
+    if (index == multigrid->depth - 1)
+    {
+        solveCoarsest(multigrid);
+        return;
+    }
+    MultigridLevel *level = &multigrid->levels[index];
+    MultigridLevel *coarse = &multigrid->levels[index + 1];
+
+    smoothLevel(level, MULTIGRID_SMOOTHING_SWEEPS);
+    computeResidual(level);
+    restrictResidual(level, coarse);
+    vCycle(multigrid, index + 1);
+    prolongCorrection(coarse, level);
+    smoothLevel(level, MULTIGRID_SMOOTHING_SWEEPS);
+}
+
+/**
+ * Relaxes the grid split between processes by rows using multigrid V-cycles, with relaxGrid as the smoother
+ * converges in a number of cycles that hardly grows with the dimension, where Jacobi iteration grows with its square
+ * returns the number of V-cycles performed, with this process's rows of the final grid in result
+ */
+int relaxMultigrid(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size)
+{
+    int dimension = options->dimension;
+    calculateAllocation(dimension, size, rank, &layout->row_start, &layout->rows);
+    layout->column_start = 0;
+    layout->columns = dimension;
+
+    Grid grid = loadGrid(options, layout, 1, 0);
+    Multigrid *multigrid = createMultigrid(&grid, dimension, 1, layout->row_start, layout->rows, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        // the gathered hierarchy's finest level is the split hierarchy's coarsest, so that level is only counted once
+        Multigrid *gathered = multigrid->gathered;
+        int levels = multigrid->depth + (gathered != NULL ? gathered->depth - 1 : 0);
+        if (gathered == NULL)
+        {
+            printf("Using multigrid with %d levels\n", levels);
+        }
+        else if (multigrid->depth == 1)
+        {
+            printf("Using multigrid with %d levels, all gathered onto one process%s\n", levels,
+                   dimension > MULTIGRID_COARSEST_DIMENSION ? " as the processes hold too few rows to coarsen the grid between them" : "");
+        }
+        else
+        {
+            printf("Using multigrid with %d levels, the coarsest %d of them (from %d x %d) gathered onto one process\n", levels,
+                   gathered->depth, gathered->levels[0].dimension, gathered->levels[0].dimension);
+        }
+    }
+
+    int finished = 0;
+    int iterations = 0;
+    while (!finished)
+    {
+        vCycle(multigrid, 0);
+        iterations++;
+
+        // the finest level's residual is also the largest change one more Jacobi iteration would make,
+        // so it is compared against the same precision
+        double max_delta = computeResidual(&multigrid->levels[0]);
+        if (!isfinite(max_delta))
+        {
+            fprintf(stderr, "Multigrid diverged after %d V-cycles (the residual is no longer finite)\n", iterations);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        finished = checkConvergence(&options->check, max_delta, iterations, options->precision) != CHECK_CONTINUE;
+    }
 
-    char *file_name = NULL;
-    char *performance_out = NULL;
-    char *out_file_name;
+    destroyMultigrid(multigrid);
+    *result = grid;
+    return iterations;
+}
 
-    while ((opt = getopt(argc, argv, "t:wd:p:f:")) != -1)
+/**
+ * Sum of the products of two grids' corresponding values over the given rows, across all processes
+ */
+double dotProduct(Grid *a, Grid *b, int first_row, int end_row)
+{
+    double local = 0;
+    for (int s = first_row; s < end_row; s++)
     {
-        switch (opt)
+        const double *a_row = GRID_ROW(a, s);
+        const double *b_row = GRID_ROW(b, s);
+        for (int x = 1; x < a->columns - 1; x++)
         {
-        case 'd':
-            dimension = atoi(optarg);
-            break;
-        case 'f':
-            file_name = optarg;
-            break;
-        case 'p':
-            precision = atof(optarg);
-            break;
-        case 'w':
-            write_to_file = 1;
-            break;
-        case 't':
-            performance_testing = 1;
-            performance_out = optarg;
-        default:
-            break;
+            local += a_row[x] * b_row[x];
         }
     }
+    double total;
+    MPI_CHECK(MPI_Allreduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD));
+    return total;
+}
 
-    // Check arguements:
-    if (dimension == -1)
+/**
+ * Applies the 5 point Laplacian, Ax = 4x - (sum of x's neighbours), to the given rows of a grid whose ghost rows
+ * are up to date, using relaxGrid for the neighbour sums
+ * with subtract set the result is taken away from what is already in out, otherwise it replaces it
+ */
+void applyLaplacian(Grid *x_grid, Grid *out, Grid *scratch, int first_row, int end_row, int subtract)
+{
+    relaxGrid(x_grid, scratch, first_row, end_row - first_row);
+    for (int s = first_row; s < end_row; s++)
     {
-        printf("-d is mandatory!\n");
-        MPI_Abort(MPI_COMM_WORLD, 1);
+        const double *x = GRID_ROW(x_grid, s);
+        const double *average = GRID_ROW(scratch, s);
+        double *row = GRID_ROW(out, s);
+        for (int c = 1; c < x_grid->columns - 1; c++)
+        {
+            double product = 4 * (x[c] - average[c]);
+            row[c] = subtract ? row[c] - product : product;
+        }
     }
+}
 
-    if (file_name == NULL)
+/**
+ * Applies a preconditioner to the residual r, giving z
+ * block Jacobi ignores the values held by other processes and approximately solves each process's block of rows
+ * with a symmetric Gauss-Seidel sweep (forwards then backwards), which keeps the preconditioner symmetric as CG needs
+ */
+void precondition(Preconditioner preconditioner, Grid *r, Grid *z, int first_row, int end_row)
+{
+    int columns = r->columns;
+    if (preconditioner == PRECONDITIONER_JACOBI)
     {
-        file_name = malloc(sizeof(char) * 50);
-
-        sprintf(file_name, "grids/grid_%d.bin", dimension);
+        // the diagonal of the Laplacian is 4 everywhere
+        for (int s = first_row; s < end_row; s++)
+        {
+            const double *r_row = GRID_ROW(r, s);
+            double *z_row = GRID_ROW(z, s);
+            for (int x = 1; x < columns - 1; x++)
+            {
+                z_row[x] = r_row[x] * 0.25;
+            }
+        }
+        return;
     }
 
-    // setup the file name to write the final grid to
-    out_file_name = malloc(sizeof(char) * 50);
-    sprintf(out_file_name, "grids/grid_%d_out.bin", dimension);
-
-    double t1, t2, time_taken;
-    if (rank == 0 && performance_testing)
+    // forwards: solve (D + L)w = r, values outside the block (and on the edges) being taken as 0
+    for (int s = first_row; s < end_row; s++)
     {
-        t1 = MPI_Wtime();
+        const double *r_row = GRID_ROW(r, s);
+        const double *above = s > first_row ? GRID_ROW(z, s - 1) : NULL;
+        double *z_row = GRID_ROW(z, s);
+        z_row[0] = 0;
+        for (int x = 1; x < columns - 1; x++)
+        {
+            z_row[x] = (r_row[x] + (above != NULL ? above[x] : 0) + z_row[x - 1]) * 0.25;
+        }
     }
-
-    // Setup Grid
-    // Calculate each proccess' allocation
-    int remainder = dimension % size;
-    int allocStart;
-    int allocRows;
-
-    // the total number of rows that cannot be distributed evenly is calculated as remainder
-    // all process with rank less than the remainder are then handed on extra row such that all rows are assigned
-
-    // for the group of processes that are assigned extra rows we can calculate the start location of the allocation simply,
-    // the later processes have a different(smaller) value for allocRows so we must add the remainder to account for the extra rows
-    if (rank < remainder)
+    // backwards: solve (D + U)z = Dw in place
+    for (int s = end_row - 1; s >= first_row; s--)
     {
-        allocRows = dimension / size + 1;
-        allocStart = rank * allocRows;
+        const double *below = s < end_row - 1 ? GRID_ROW(z, s + 1) : NULL;
+        double *z_row = GRID_ROW(z, s);
+        z_row[columns - 1] = 0;
+        for (int x = columns - 2; x >= 1; x--)
+        {
+            z_row[x] = (4 * z_row[x] + (below != NULL ? below[x] : 0) + z_row[x + 1]) * 0.25;
+        }
     }
-    else
+    // put the edge columns back, z is treated as 0 there
+    for (int s = first_row; s < end_row; s++)
     {
-        allocRows = dimension / size;
-        //remainder is added to account for the total number of extra rows that have been allocated
-        allocStart = rank * allocRows + remainder;
+        GRID_ROW(z, s)[0] = 0;
+        GRID_ROW(z, s)[columns - 1] = 0;
     }
+}
 
-    // set up the two grids, reading the process's allocated portion of the overall grid from file
-    double **in_grid = readGrid(file_name, dimension, allocStart, allocRows, rank);
-    double **out_grid = allocateGridMem(allocRows, dimension);
+/**
+ * Relaxes the grid split between processes by rows with the conjugate gradient method, optionally preconditioned
+ * the matrix-vector product uses the same ghost row exchange and relaxGrid as the relaxation methods, and the dot products MPI_Allreduce
+ * stops on the same criterion as Jacobi iteration: the largest change another Jacobi iteration would make (a quarter of the residual),
+ * confirmed against the true residual before finishing, since the one CG updates drifts from it with rounding errors
+ * returns the number of iterations performed, with this process's rows of the final grid in result
+ */
+int relaxConjugateGradient(SolverOptions *options, Grid *result, GridLayout *layout, int rank, int size)
+{
+    static const char *names[] = {"no", "Jacobi", "block Jacobi"};
+    if (rank == 0)
+    {
+        printf("Using conjugate gradients with %s preconditioning\n", names[options->preconditioner]);
+    }
 
-    // assign overall edges in the outgrid (these never change)
-    copyEdges(in_grid, out_grid, allocRows, dimension, rank, size);
+    int dimension = options->dimension;
+    calculateAllocation(dimension, size, rank, &layout->row_start, &layout->rows);
+    layout->column_start = 0;
+    layout->columns = dimension;
+    int rows = layout->rows;
 
-    // used to receive the row directly above or below the processes allocation from an adjacent process
-    double *top_edge_neighbours = (double *)malloc(sizeof(double) * dimension);
-    double *bottom_edge_neighbours = (double *)malloc(sizeof(double) * dimension);
+    Grid x = loadGrid(options, layout, 1, 0);
+    Grid p = allocateGridMem(rows, dimension, 1, 0);
+    Grid r = allocateGridMem(rows, dimension, 0, 0);
+    Grid q = allocateGridMem(rows, dimension, 0, 0);
+    Grid scratch = allocateGridMem(rows, dimension, 0, 0);
+    Grid z_grid = allocateGridMem(rows, dimension, 0, 0);
+    // p is 0 on the fixed edges (and in ghost rows past them), so Ap only involves the values being solved for
+    clearGrid(&p);
+    clearGrid(&r);
+    Grid *z = options->preconditioner == PRECONDITIONER_NONE ? &r : &z_grid;
 
-    MPI_Request send_top_edge_req;
-    MPI_Request send_bottom_edge_req;
+    MPI_Request x_halo[4], p_halo[4];
+    initGhostRowExchange(&x, x_halo, MPI_COMM_WORLD, rank, size);
+    initGhostRowExchange(&p, p_halo, MPI_COMM_WORLD, rank, size);
 
-    MPI_Request rec_top_neighbours_req;
-    MPI_Request rec_bottom_neighbours_req;
+    int first_row, end_row;
+    interiorRows(layout->row_start, rows, dimension, &first_row, &end_row);
 
-    // the global finished, boolean that signifies whether all processes have finished
     int finished = 0;
-
+    int iterations = 0;
     while (!finished)
     {
-        //Send edges (Asynchronously)
-
-        // if not the first process (first process has no neighbour above)
-        // send the top edge of the allocation
-        if (rank != 0)
-        {
-            MPI_CHECK(MPI_Isend(in_grid[0], dimension, MPI_DOUBLE, rank - 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, &send_top_edge_req));
-        }
-        // if not the final process (final process has no neighbour below)
-        // send bottom edge of the allocation
-        if (rank != size - 1)
-        {
-            MPI_CHECK(MPI_Isend(in_grid[allocRows - 1], dimension, MPI_DOUBLE, rank + 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, &send_bottom_edge_req));
-        }
+        // (re)start from the true residual, r = -Ax (the right hand side being 0)
+        MPI_CHECK(MPI_Startall(4, x_halo));
+        MPI_CHECK(MPI_Waitall(4, x_halo, MPI_STATUSES_IGNORE));
+        clearGrid(&r);
+        applyLaplacian(&x, &r, &scratch, first_row, end_row, 1);
 
-        // Receive edge neighbours (Asycnchronously)
-
-        // if not first process
-        // receive top edge neighbours
-        if (rank != 0)
+        double max_delta = 0;
+        for (int s = first_row; s < end_row; s++)
         {
-            MPI_CHECK(MPI_Irecv(top_edge_neighbours, dimension, MPI_DOUBLE, rank - 1, SEND_BOTTOM_EDGE_TAG, MPI_COMM_WORLD, &rec_top_neighbours_req));
+            for (int c = 1; c < dimension - 1; c++)
+            {
+                max_delta = fmax(max_delta, fabs(GRID_ROW(&r, s)[c]) * 0.25);
+            }
         }
-        // if not final process
-        // recieve bottom edge neighbours
-        if (rank != size - 1)
+        double true_delta;
+        MPI_CHECK(MPI_Allreduce(&max_delta, &true_delta, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD));
+        if (true_delta <= options->precision)
         {
-            MPI_CHECK(MPI_Irecv(bottom_edge_neighbours, dimension, MPI_DOUBLE, rank + 1, SEND_TOP_EDGE_TAG, MPI_COMM_WORLD, &rec_bottom_neighbours_req));
+            break;
         }
-        // Calculate internal
-        // i.e. ingrid[1] to ingrid[allocRows-1]
-        relaxGrid(in_grid, out_grid, 1, allocRows - 2, dimension);
-
-        // Await neighbours and Calculate edges
 
-        // if not the first process (first process contains the overall top row which is constant)
-        // await neighbours and use them to calculate the top edge of the allocation
-        if (rank != 0)
+        if (z != &r)
         {
-            MPI_Wait(&rec_top_neighbours_req, MPI_STATUS_IGNORE);
-            relaxEdge(in_grid[0], top_edge_neighbours, in_grid[1], out_grid[0], dimension);
+            precondition(options->preconditioner, &r, z, first_row, end_row);
         }
-        // if not the final process (final process contains the overall bottom row which is constant)
-        // await neighbours and use them to calculate the bottom edge of the allocation
-        if (rank != size - 1)
+        for (int s = first_row; s < end_row; s++)
         {
-            MPI_Wait(&rec_bottom_neighbours_req, MPI_STATUS_IGNORE);
-            relaxEdge(in_grid[allocRows - 1], bottom_edge_neighbours, in_grid[allocRows - 2], out_grid[allocRows - 1], dimension);
+            memcpy(GRID_ROW(&p, s) + 1, GRID_ROW(z, s) + 1, sizeof(double) * (dimension - 2));
         }
+        double rz = dotProduct(&r, z, first_row, end_row);
 
-        // Await edge sends
-        // if they were sent
-        if (rank != 0)
-        {
-            MPI_Wait(&send_top_edge_req, MPI_STATUS_IGNORE);
-        }
-        if (rank != size - 1)
+        int converged = 0;
+        while (!converged)
         {
-            MPI_Wait(&send_bottom_edge_req, MPI_STATUS_IGNORE);
-        }
-
-        // check if this proccess's allocation is complete to the precision
-        int local_finished = checkComplete(in_grid, out_grid, allocRows, dimension, precision);
+            MPI_CHECK(MPI_Startall(4, p_halo));
+            MPI_CHECK(MPI_Waitall(4, p_halo, MPI_STATUSES_IGNORE));
+            applyLaplacian(&p, &q, &scratch, first_row, end_row, 0);
+            double alpha = rz / dotProduct(&p, &q, first_row, end_row);
 
-        // perform a reduce to check whether or not all processes have finished with their allocation
-        MPI_CHECK(MPI_Allreduce(&local_finished, &finished, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD));
+            max_delta = 0;
+            for (int s = first_row; s < end_row; s++)
+            {
+                double *x_row = GRID_ROW(&x, s);
+                double *r_row = GRID_ROW(&r, s);
+                const double *p_row = GRID_ROW(&p, s);
+                const double *q_row = GRID_ROW(&q, s);
+                for (int c = 1; c < dimension - 1; c++)
+                {
+                    x_row[c] += alpha * p_row[c];
+                    r_row[c] -= alpha * q_row[c];
+                    max_delta = fmax(max_delta, fabs(r_row[c]));
+                }
+            }
+            iterations++;
+            converged = checkConvergence(&options->check, max_delta * 0.25, iterations, options->precision) != CHECK_CONTINUE;
+            if (converged)
+            {
+                break;
+            }
 
-        // if not all processes are finished, swap grids so that the old out_grid can be used as the input for the next iteration
-        // Allreduce is blocking so acts as a barrier to synchronise processes,
-        // this means all the proccesses will have finished their computation and we can swap the grids without race conditions
-        if (!finished)
-        {
-            swapGrids(in_grid, out_grid, allocRows);
+            if (z != &r)
+            {
+                precondition(options->preconditioner, &r, z, first_row, end_row);
+            }
+            double rz_next = dotProduct(&r, z, first_row, end_row);
+            double beta = rz_next / rz;
+            rz = rz_next;
+            for (int s = first_row; s < end_row; s++)
+            {
+                double *p_row = GRID_ROW(&p, s);
+                const double *z_row = GRID_ROW(z, s);
+                for (int c = 1; c < dimension - 1; c++)
+                {
+                    p_row[c] = z_row[c] + beta * p_row[c];
+                }
+            }
         }
     }
-    printf("Process %d finishing\n", rank);
 
-    if (rank == 0 && performance_testing)
+    for (int i = 0; i < 4; i++)
     {
-        // record the time taken
-        t2 = MPI_Wtime();
-        time_taken = t2 - t1;
-
-        MPI_File handle;
-        MPI_Status status;
-        MPI_CHECK(MPI_File_open(MPI_COMM_SELF, performance_out, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &handle));
+        MPI_CHECK(MPI_Request_free(&x_halo[i]));
+        MPI_CHECK(MPI_Request_free(&p_halo[i]));
+    }
+    freeGridMem(&p);
+    freeGridMem(&r);
+    freeGridMem(&q);
+    freeGridMem(&scratch);
+    freeGridMem(&z_grid);
 
-        MPI_CHECK(MPI_File_seek(handle, 0, MPI_SEEK_END));
-        char *buf = malloc(100 * sizeof(char));
+    *result = x;
+    return iterations;
+}
 
-        sprintf(buf, "%d, %f, %d, %f \n", dimension, precision, size, time_taken);
-        MPI_CHECK(MPI_File_write(handle, buf, strlen(buf), MPI_CHAR, &status));
+/**
+ * Sets up a convergence check policy from a -c arguement: every:<iterations>, adaptive[:<max iterations>] or overlap
+ * returns 0 on success, -1 if the arguement is not recognised
+ */
+int parseConvergenceCheck(const char *arg, ConvergenceCheck *check)
+{
+    int interval = 1;
+    memset(check, 0, sizeof(ConvergenceCheck));
 
-        MPI_CHECK(MPI_File_close(&handle));
+    if (sscanf(arg, "every:%d", &interval) == 1 && interval > 0)
+    {
+        check->mode = CHECK_EVERY;
     }
-
-    // output the final grid to a file for correctness testing
-    if (write_to_file)
-    {  
-        writeGrid(out_grid, out_file_name, dimension, allocStart, allocRows);
+    else if (strcmp(arg, "adaptive") == 0 || (sscanf(arg, "adaptive:%d", &interval) == 1 && interval > 0))
+    {
+        check->mode = CHECK_ADAPTIVE;
+        // intervals start at one iteration and grow up to the given maximum (64 if not given)
+        interval = strcmp(arg, "adaptive") == 0 ? 64 : interval;
     }
-
-    // clean up memory
-    free(top_edge_neighbours);
-    free(bottom_edge_neighbours);
-    free(file_name);
-    free(out_file_name);
-
-    for (int i = 0; i < allocRows; i++)
+    else if (strcmp(arg, "overlap") == 0)
     {
-        free(in_grid[i]);
-        free(out_grid[i]);
+        check->mode = CHECK_OVERLAPPED;
     }
-    free(in_grid);
-    free(out_grid);
-
-    MPI_Finalize();
-
+    else
+    {
+        return -1;
+    }
+    check->interval = interval;
+    check->next_check = check->mode == CHECK_EVERY ? interval : 1;
+    check->request = MPI_REQUEST_NULL;
     return 0;
 }
 
 /**
- * Function that is called once to copy the values at the 'edge' of one grid to another
- * this function considers the grid as a whole (across processes)
+ * Combines each process's largest change to decide whether the relaxation is complete, when the check policy says one is due
+ * iterations is the number of iterations performed so far, max_delta the largest change this process made in the latest one
+ * returns CHECK_CONTINUE, CHECK_FINISHED, or CHECK_FINISHED_PREVIOUS when an overlapped check confirms the previous iteration
  */
-double **copyEdges(double **from_grid, double **to_grid, int allocRows, int dimension, int rank, int size)
+int checkConvergence(ConvergenceCheck *check, double max_delta, int iterations, double precision)
 {
-    // Copy the first and last value of each row
-    for (int y = 0; y < allocRows; y++)
-    {
-        to_grid[y][0] = from_grid[y][0];
-        to_grid[y][dimension - 1] = from_grid[y][dimension - 1];
-    }
-    // Copy the top row
-    if (rank == 0)
+    if (check->mode == CHECK_OVERLAPPED)
     {
-        for (int x = 0; x < dimension; x++)
+        // the previous iteration's reduction has been in flight while this iteration was computed
+        if (check->pending)
         {
-            to_grid[0][x] = from_grid[0][x];
+            MPI_CHECK(MPI_Wait(&check->request, MPI_STATUS_IGNORE));
+            check->pending = 0;
+            if (check->recv_delta <= precision)
+            {
+                return CHECK_FINISHED_PREVIOUS;
+            }
         }
+        check->send_delta = max_delta;
+        MPI_CHECK(MPI_Iallreduce(&check->send_delta, &check->recv_delta, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD, &check->request));
+        check->pending = 1;
+        return CHECK_CONTINUE;
     }
-    //Copy the bottom row
-    if (rank == size - 1)
+
+    if (iterations < check->next_check)
+    {
+        return CHECK_CONTINUE;
+    }
+
+    double global_delta;
+    MPI_CHECK(MPI_Allreduce(&max_delta, &global_delta, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD));
+    if (global_delta <= precision)
+    {
+        return CHECK_FINISHED;
+    }
+
+    int next_interval = check->interval;
+    if (check->mode == CHECK_ADAPTIVE)
     {
-        for (int x = 0; x < dimension; x++)
+        // double the interval each time, but not beyond the point the largest change is expected to reach the precision
+        // (it shrinks roughly geometrically, so the rate is estimated from the change since the previous check)
+        next_interval = 2 * (iterations - check->last_check);
+        if (check->last_delta > global_delta && global_delta > 0)
         {
-            to_grid[allocRows - 1][x] = from_grid[allocRows - 1][x];
+            double rate = log(global_delta / check->last_delta) / (iterations - check->last_check);
+            double remaining = ceil(log(precision / global_delta) / rate);
+            if (remaining < next_interval)
+            {
+                next_interval = (int)remaining;
+            }
         }
+        next_interval = next_interval < 1 ? 1 : next_interval;
+        next_interval = next_interval > check->interval ? check->interval : next_interval;
+
+        check->last_check = iterations;
+        check->last_delta = global_delta;
     }
-    return to_grid;
+    check->next_check = iterations + next_interval;
+    return CHECK_CONTINUE;
 }
 
 /**
- * Function used to read the allocated rows from a binary file containing a grid of doubles in parallel
+ * Completes any reduction an overlapped check still has in flight, for when the relaxation stops without it finishing
+ * (every process must call this, as it was started by every process)
  */
-double **readGrid(char *file_name, int dimension, int allocStart, int allocRows, int rank)
+void abandonConvergenceCheck(ConvergenceCheck *check)
 {
+    if (check->pending)
+    {
+        MPI_CHECK(MPI_Wait(&check->request, MPI_STATUS_IGNORE));
+        check->pending = 0;
+    }
+}
 
-    double **read = allocateGridMem(allocRows, dimension);
-
-    MPI_File handle;
-    MPI_Status status;
-    MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &handle));
-
-    MPI_CHECK(MPI_File_seek(handle, allocStart * dimension * sizeof(double), MPI_SEEK_SET));
-
-    for (int x = 0; x < allocRows; x++)
+/**
+ * Row kernel that calculates the average of each cell's four neighbours one value at a time
+ * also used by the vector kernels to finish off any values left over after the last full vector
+ */
+double relaxRowScalar(const double *restrict above, const double *restrict row, const double *restrict below,
+                      double *restrict out, int columns)
+{
+    double max_delta = 0;
+    for (int x = 1; x < columns - 1; x++)
     {
-        MPI_CHECK(MPI_File_read(handle, read[x], dimension, MPI_DOUBLE, &status));
-        for (int y = 0; y < dimension; y++)
+        double value = (above[x] + below[x] + row[x - 1] + row[x + 1]) * 0.25;
+        double delta = fabs(value - row[x]);
+        out[x] = value;
+        if (delta > max_delta)
         {
-            //printf("%f ", read[x][y]);
+            max_delta = delta;
         }
-        //printf("\n");
     }
-    MPI_CHECK(MPI_File_close(&handle));
-
-    return read;
+    return max_delta;
 }
 
+#ifdef HAVE_X86_KERNELS
 /**
- * Function used to write the allocated rows to a binary file at the correct position
+ * Row kernel processing two values per instruction with SSE2
  */
-void writeGrid(double **grid, char *file_name, int dimension, int allocStart, int allocRows)
+__attribute__((target("sse2"))) static double relaxRowSSE2(const double *restrict above, const double *restrict row,
+                                                           const double *restrict below, double *restrict out, int columns)
 {
+    const __m128d quarter = _mm_set1_pd(0.25);
+    const __m128d sign_bit = _mm_set1_pd(-0.0);
+    __m128d max_delta = _mm_setzero_pd();
+    int x = 1;
+    for (; x + 2 <= columns - 1; x += 2)
+    {
+        __m128d sum = _mm_add_pd(_mm_loadu_pd(above + x), _mm_loadu_pd(below + x));
+        sum = _mm_add_pd(sum, _mm_loadu_pd(row + x - 1));
+        sum = _mm_add_pd(sum, _mm_loadu_pd(row + x + 1));
+        __m128d value = _mm_mul_pd(sum, quarter);
+        _mm_storeu_pd(out + x, value);
+        max_delta = _mm_max_pd(max_delta, _mm_andnot_pd(sign_bit, _mm_sub_pd(value, _mm_loadu_pd(row + x))));
+    }
+    max_delta = _mm_max_sd(max_delta, _mm_unpackhi_pd(max_delta, max_delta));
 
-    MPI_File handle;
-    MPI_Status status;
-    MPI_CHECK(MPI_File_open(MPI_COMM_WORLD, file_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &handle));
+    // the scalar kernel starts at x + 1, so hand it the row shifted to start at x - 1
+    double tail_delta = relaxRowScalar(above + x - 1, row + x - 1, below + x - 1, out + x - 1, columns - x + 1);
+    return fmax(_mm_cvtsd_f64(max_delta), tail_delta);
+}
 
-    MPI_CHECK(MPI_File_seek(handle, allocStart * dimension * sizeof(double), MPI_SEEK_SET));
+/**
+ * Row kernel processing four values per instruction with AVX2
+ */
+__attribute__((target("avx2"))) static double relaxRowAVX2(const double *restrict above, const double *restrict row,
+                                                           const double *restrict below, double *restrict out, int columns)
+{
+    const __m256d quarter = _mm256_set1_pd(0.25);
+    const __m256d sign_bit = _mm256_set1_pd(-0.0);
+    __m256d max_delta = _mm256_setzero_pd();
+    int x = 1;
+    for (; x + 4 <= columns - 1; x += 4)
+    {
+        __m256d sum = _mm256_add_pd(_mm256_loadu_pd(above + x), _mm256_loadu_pd(below + x));
+        sum = _mm256_add_pd(sum, _mm256_loadu_pd(row + x - 1));
+        sum = _mm256_add_pd(sum, _mm256_loadu_pd(row + x + 1));
+        __m256d value = _mm256_mul_pd(sum, quarter);
+        _mm256_storeu_pd(out + x, value);
+        max_delta = _mm256_max_pd(max_delta, _mm256_andnot_pd(sign_bit, _mm256_sub_pd(value, _mm256_loadu_pd(row + x))));
+    }
+    __m128d half = _mm_max_pd(_mm256_castpd256_pd128(max_delta), _mm256_extractf128_pd(max_delta, 1));
+    half = _mm_max_sd(half, _mm_unpackhi_pd(half, half));
+
+    double tail_delta = relaxRowScalar(above + x - 1, row + x - 1, below + x - 1, out + x - 1, columns - x + 1);
+    return fmax(_mm_cvtsd_f64(half), tail_delta);
+}
 
-    for (int x = 0; x < allocRows; x++)
+/**
+ * Row kernel processing eight values per instruction with AVX-512
+ */
+__attribute__((target("avx512f"))) static double relaxRowAVX512(const double *restrict above, const double *restrict row,
+                                                                const double *restrict below, double *restrict out, int columns)
+{
+    const __m512d quarter = _mm512_set1_pd(0.25);
+    __m512d max_delta = _mm512_setzero_pd();
+    int x = 1;
+    for (; x + 8 <= columns - 1; x += 8)
     {
-        MPI_CHECK(MPI_File_write(handle, grid[x], dimension, MPI_DOUBLE, &status));
-        for (int y = 0; y < dimension; y++)
-        {
-            //printf("%f ", grid[x][y]);
-        }
-        //printf("\n");
+        __m512d sum = _mm512_add_pd(_mm512_loadu_pd(above + x), _mm512_loadu_pd(below + x));
+        sum = _mm512_add_pd(sum, _mm512_loadu_pd(row + x - 1));
+        sum = _mm512_add_pd(sum, _mm512_loadu_pd(row + x + 1));
+        __m512d value = _mm512_mul_pd(sum, quarter);
+        _mm512_storeu_pd(out + x, value);
+        max_delta = _mm512_max_pd(max_delta, _mm512_abs_pd(_mm512_sub_pd(value, _mm512_loadu_pd(row + x))));
     }
-    MPI_CHECK(MPI_File_close(&handle));
+
+    double tail_delta = relaxRowScalar(above + x - 1, row + x - 1, below + x - 1, out + x - 1, columns - x + 1);
+    return fmax(_mm512_reduce_max_pd(max_delta), tail_delta);
 }
+#endif
 
 /**
- * Function that performs relaxation on all the values in a row, when provided with the rows above and below
- * this is used for the edges of a process's allocation
+ * Single precision version of relaxRowScalar, for the mixed precision sweeps
  */
-double *relaxEdge(double *in_edge, double *neighbours_above, double *neighbours_below, double *out_edge, int columns)
+float relaxRowFloatScalar(const float *restrict above, const float *restrict row, const float *restrict below,
+                          float *restrict out, int columns)
 {
+    float max_delta = 0;
     for (int x = 1; x < columns - 1; x++)
     {
-        double sum = 0;
-        sum = sum + neighbours_above[x];
-        sum = sum + neighbours_below[x];
-
-        sum = sum + in_edge[x - 1];
-        sum = sum + in_edge[x + 1];
-        out_edge[x] = sum / 4;
+        float value = (above[x] + below[x] + row[x - 1] + row[x + 1]) * 0.25f;
+        float delta = fabsf(value - row[x]);
+        out[x] = value;
+        if (delta > max_delta)
+        {
+            max_delta = delta;
+        }
     }
-    return out_edge;
+    return max_delta;
 }
 
+#ifdef HAVE_X86_KERNELS
 /**
- * Function that calculates the average of a cell's four neighbours
+ * Single precision row kernel processing four values per instruction with SSE2
  */
-double relaxCell(double **grid, int row, int column)
+__attribute__((target("sse2"))) static float relaxRowFloatSSE2(const float *restrict above, const float *restrict row,
+                                                               const float *restrict below, float *restrict out, int columns)
 {
-    double sum = 0;
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    __m128 max_delta = _mm_setzero_ps();
+    int x = 1;
+    for (; x + 4 <= columns - 1; x += 4)
+    {
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(above + x), _mm_loadu_ps(below + x));
+        sum = _mm_add_ps(sum, _mm_loadu_ps(row + x - 1));
+        sum = _mm_add_ps(sum, _mm_loadu_ps(row + x + 1));
+        __m128 value = _mm_mul_ps(sum, quarter);
+        _mm_storeu_ps(out + x, value);
+        max_delta = _mm_max_ps(max_delta, _mm_andnot_ps(sign_bit, _mm_sub_ps(value, _mm_loadu_ps(row + x))));
+    }
+    max_delta = _mm_max_ps(max_delta, _mm_movehl_ps(max_delta, max_delta));
+    max_delta = _mm_max_ss(max_delta, _mm_shuffle_ps(max_delta, max_delta, 1));
 
-    sum = sum + grid[row - 1][column];
-    sum = sum + grid[row + 1][column];
-    sum = sum + grid[row][column - 1];
-    sum = sum + grid[row][column + 1];
-    return (sum / 4);
+    float tail_delta = relaxRowFloatScalar(above + x - 1, row + x - 1, below + x - 1, out + x - 1, columns - x + 1);
+    return fmaxf(_mm_cvtss_f32(max_delta), tail_delta);
 }
 
 /**
- * Function that performs relaxation on all values in a grid that are not on the edge for the given number of rows
+ * Single precision row kernel processing eight values per instruction with AVX2
  */
-double **relaxGrid(double **in_grid, double **out_grid, int start_row, int rows, int columns)
+__attribute__((target("avx2"))) static float relaxRowFloatAVX2(const float *restrict above, const float *restrict row,
+                                                               const float *restrict below, float *restrict out, int columns)
 {
-    for (int s = start_row; s < start_row + rows; s++)
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    __m256 max_delta = _mm256_setzero_ps();
+    int x = 1;
+    for (; x + 8 <= columns - 1; x += 8)
     {
-        for (int t = 1; t < columns - 1; t++)
-        {
-            out_grid[s][t] = relaxCell(in_grid, s, t);
-        }
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(above + x), _mm256_loadu_ps(below + x));
+        sum = _mm256_add_ps(sum, _mm256_loadu_ps(row + x - 1));
+        sum = _mm256_add_ps(sum, _mm256_loadu_ps(row + x + 1));
+        __m256 value = _mm256_mul_ps(sum, quarter);
+        _mm256_storeu_ps(out + x, value);
+        max_delta = _mm256_max_ps(max_delta, _mm256_andnot_ps(sign_bit, _mm256_sub_ps(value, _mm256_loadu_ps(row + x))));
     }
-    return out_grid;
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(max_delta), _mm256_extractf128_ps(max_delta, 1));
+    half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+
+    float tail_delta = relaxRowFloatScalar(above + x - 1, row + x - 1, below + x - 1, out + x - 1, columns - x + 1);
+    return fmaxf(_mm_cvtss_f32(half), tail_delta);
 }
 
 /**
- * Copies the values contained in one grid to another
- **/
-int swapGrids(double **fromGrid, double **toGrid, int rows)
+ * Single precision row kernel processing sixteen values per instruction with AVX-512
+ */
+__attribute__((target("avx512f"))) static float relaxRowFloatAVX512(const float *restrict above, const float *restrict row,
+                                                                    const float *restrict below, float *restrict out, int columns)
 {
-    int i;
-    double *temp;
-    for (i = 0; i < rows; i++)
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    __m512 max_delta = _mm512_setzero_ps();
+    int x = 1;
+    for (; x + 16 <= columns - 1; x += 16)
     {
-        temp = fromGrid[i];
-        fromGrid[i] = toGrid[i];
-        toGrid[i] = temp;
+        __m512 sum = _mm512_add_ps(_mm512_loadu_ps(above + x), _mm512_loadu_ps(below + x));
+        sum = _mm512_add_ps(sum, _mm512_loadu_ps(row + x - 1));
+        sum = _mm512_add_ps(sum, _mm512_loadu_ps(row + x + 1));
+        __m512 value = _mm512_mul_ps(sum, quarter);
+        _mm512_storeu_ps(out + x, value);
+        max_delta = _mm512_max_ps(max_delta, _mm512_abs_ps(_mm512_sub_ps(value, _mm512_loadu_ps(row + x))));
     }
-    return 0;
+
+    float tail_delta = relaxRowFloatScalar(above + x - 1, row + x - 1, below + x - 1, out + x - 1, columns - x + 1);
+    return fmaxf(_mm512_reduce_max_ps(max_delta), tail_delta);
 }
+#endif
 
 /**
- * Checks whether two grids have any corresponding cells with a difference greater than the specified precision 
- * returns true if the grid is complete
- **/
-int checkComplete(double **grid, double **newGrid, int rows, int columns, double precision)
+ * Picks the row kernel to use, either the one requested by name or (if name is NULL) the widest the CPU supports,
+ * along with the single precision kernel for the same instruction set
+ * returns NULL if the requested kernel does not exist or cannot run on this CPU
+ */
+RowKernel selectRowKernel(const char *name, const char **selected_name, FloatRowKernel *float_kernel)
 {
-    int i, j;
-    for (i = 0; i < rows; i++)
+    const char *names[4];
+    RowKernel kernels[4];
+    FloatRowKernel float_kernels[4];
+    int count = 0;
+
+    // kernels are listed widest first, so the first supported one is the best available
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
     {
-        for (j = 0; j < columns; j++)
+        names[count] = "avx512";
+        float_kernels[count] = relaxRowFloatAVX512;
+        kernels[count++] = relaxRowAVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        names[count] = "avx2";
+        float_kernels[count] = relaxRowFloatAVX2;
+        kernels[count++] = relaxRowAVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        names[count] = "sse2";
+        float_kernels[count] = relaxRowFloatSSE2;
+        kernels[count++] = relaxRowSSE2;
+    }
+#endif
+    names[count] = "scalar";
+    float_kernels[count] = relaxRowFloatScalar;
+    kernels[count++] = relaxRowScalar;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (name == NULL || strcmp(name, names[i]) == 0)
         {
-            if (fabs(newGrid[i][j] - grid[i][j]) > precision)
-            {
-                return 0;
-            }
+            *selected_name = names[i];
+            *float_kernel = float_kernels[i];
+            return kernels[i];
         }
     }
-    return 1;
+    return NULL;
+}
+
+/**
+ * Swaps the storage of two grids so the result of one iteration becomes the input to the next
+ * only the slab pointers are exchanged, so this takes constant time regardless of grid size
+ **/
+int swapGrids(Grid *fromGrid, Grid *toGrid)
+{
+    double *temp = fromGrid->data;
+    fromGrid->data = toGrid->data;
+    toGrid->data = temp;
+
+    temp = fromGrid->base;
+    fromGrid->base = toGrid->base;
+    toGrid->base = temp;
+    return 0;
 }
 
 /**
- * Function that allocates memory for a grid of the specified dimensions
+ * Function that allocates memory for a grid of the specified dimensions, plus halo ghost rows above and below
+ * and column_halo ghost columns either side
+ * the whole grid is a single GRID_ALIGNMENT aligned block, with each row padded to a whole number of alignment units
+ * (ghost columns are placed in a whole unit of padding before each row, so the process's values stay aligned)
  */
-double **allocateGridMem(int rows, int columns)
+Grid allocateGridMem(int rows, int columns, int halo, int column_halo)
 {
-    double **read = (double **)malloc(sizeof(double *) * rows);
+    const int values_per_unit = GRID_ALIGNMENT / sizeof(double);
+    int leading = (column_halo + values_per_unit - 1) / values_per_unit * values_per_unit;
 
-    for (int l = 0; l < rows; l++)
+    Grid grid;
+    grid.rows = rows;
+    grid.columns = columns;
+    grid.halo = halo;
+    grid.column_halo = column_halo;
+    grid.stride = (leading + columns + column_halo + values_per_unit - 1) / values_per_unit * values_per_unit;
+
+    size_t bytes = sizeof(double) * (size_t)grid.stride * (size_t)(rows + 2 * halo > 0 ? rows + 2 * halo : 1);
+    if (posix_memalign((void **)&grid.base, GRID_ALIGNMENT, bytes) != 0)
     {
-        read[l] = (double *)malloc(sizeof(double) * columns);
+        fprintf(stderr, "allocateGridMem: unable to allocate %zu bytes\n", bytes);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    return read;
+    grid.data = grid.base + (size_t)halo * grid.stride + leading;
+    return grid;
+}
+
+/**
+ * Function that releases the memory held by a grid
+ */
+void freeGridMem(Grid *grid)
+{
+    free(grid->base);
+    grid->base = NULL;
+    grid->data = NULL;
 }
@@ -1,34 +1,152 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <dirent.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 #define BILLION 1000000000L;
 
-const int workerThreads = 4;
-const int dimension = 10;
-const double precision = 0.1;
+//size of a cache line, used to keep values written by different threads on separate lines
+#define CACHE_LINE_BYTES 64
 
-pthread_barrier_t barrier1;
-pthread_barrier_t barrier2;
+//independent running maxima kept by relaxRow
+#define RELAX_LANES 4
+
+//kinds of barrier the workers can synchronise with
+#define BARRIER_PTHREAD 0 //pthread_barrier_t, which sleeps in the kernel while waiting
+#define BARRIER_SPIN 1    //spinBarrier, which spins on a shared flag and only gives up the processor if the wait drags on
+
+//checks of the flag a spinBarrier makes before each yield of the processor
+#define SPIN_BEFORE_YIELD 1024
+
+//jobs the workers can be handed
+#define JOB_POPULATE 0 //fill in the initial values of the worker's rows of both grids
+#define JOB_RELAX 1    //relax the grid until complete
+
+//pages of each worker's rows checked for the placement report
+#define PLACEMENT_SAMPLES 64
+
+//ways of sharing out the rows of each iteration
+#define SCHEDULER_STATIC 0 //each worker relaxes its own block of rows, and nothing else
+#define SCHEDULER_STEAL 1  //workers relax their own block a tile at a time, then steal tiles from the others' blocks
+
+//bytes of each grid a tile of rows is sized to cover, so a tile's rows stay in cache between being read and relaxed
+#define TILE_BYTES (1 << 18)
+//fewest tiles each worker's block is split into, so there is something to steal even in small grids
+#define MIN_TILES_PER_WORKER 4
+
+struct workerPool;
+
+/**
+ * Sense reversing barrier built on C11 atomics, which never enters the kernel while the other threads arrive promptly
+ * the sense is the parity of generation, which the last thread to arrive advances to release the others
+ **/
+struct spinBarrier
+{
+    atomic_int remaining; //threads yet to arrive this time round
+    char padding[CACHE_LINE_BYTES - sizeof(atomic_int)];
+    atomic_int generation; //on its own line, so the waiting threads are not disturbed by each arrival
+    int threads;
+};
+
+/**
+ * Barrier of either kind, chosen when it is created
+ **/
+struct poolBarrier
+{
+    int kind;
+    pthread_barrier_t pthreadBarrier;
+    struct spinBarrier spin;
+};
+
+/**
+ * A worker's largest change in an iteration, padded out to a whole cache line so workers never write to the same line
+ **/
+struct paddedDelta
+{
+    double delta;
+    char padding[CACHE_LINE_BYTES - sizeof(double)];
+};
+
+/**
+ * The rows of a worker's block not yet taken this iteration, packed as (end << 32) | start so they change in one atomic step
+ * the owner takes tiles from the start and thieves from the end, so the owner works through its rows in order
+ **/
+struct tileDeque
+{
+    _Atomic uint64_t rows;
+    char padding[CACHE_LINE_BYTES - sizeof(uint64_t)];
+};
 
 struct threadArgs
 {
-    double **inGrid;
-    double **outGrid;
+    struct workerPool *pool;
     int startRow, endRow; //start row is inclusive, end row is exclusive
+    int cpu;              //the processor the worker last populated its rows on
+    long stolen;          //tiles stolen from other workers during the current relaxation
 } threadArgs;
 
-int populateGrid(double *grid[dimension]);
-double relaxCell(double *grid[dimension], int row, int column);
-int checkComplete(double *grid[dimension], double *newGrid[dimension]);
-int printGrid(double *grid[dimension]);
-int relaxGrid(double *inGrid[dimension], double *outGrid[dimension]);
-int swapGrids(double *fromGrid[dimension], double *toGrid[dimension]);
+/**
+ * Worker threads that stay alive between relaxations, so a run of relaxations only creates threads once
+ * between relaxations the workers wait at the barrier, and they leave when stop is set
+ **/
+struct workerPool
+{
+    int workerThreads;
+    pthread_t *threadIds;
+    struct threadArgs *args;
+    struct poolBarrier barrier; //the single barrier ending every iteration (and starting every relaxation)
+    int stop;                  //set by the main thread (only while the workers are at the barrier) to end the workers
+
+    //each worker's largest change, for even and odd iterations so the next iteration's can be written
+    //while a slow thread is still reading the last
+    struct paddedDelta *deltas[2];
+
+    int scheduler;
+    struct tileDeque *deques; //each worker's rows still to relax in the current iteration, with SCHEDULER_STEAL
+    int tileRows;
+
+    //the job being worked on, for relaxations iterations relax from grids[0] into grids[1] then back again
+    int job;
+    double **grids[2];
+    int dimension;
+    double precision;
+};
 
-int main()
+int parseBarrier(const char *name);
+void initBarrier(struct poolBarrier *barrier, int kind, int threads);
+void waitBarrier(struct poolBarrier *barrier);
+void destroyBarrier(struct poolBarrier *barrier);
+void benchmarkBarriers(int maxThreads, int barriers);
+int parseCpuList(const char *list, int **cpus);
+int cpuNode(int cpu);
+struct workerPool *createPool(int workerThreads, int barrierKind, int scheduler, const int *cpus, int cpuCount);
+void destroyPool(struct workerPool *pool);
+double **allocateGrid(int dimension);
+void freeGrid(double **grid, int dimension);
+int populateRows(double **grid, int dimension, int firstRow, int endRow);
+void assignRows(struct workerPool *pool, int dimension);
+void populateGrids(struct workerPool *pool, double **grid, double **newGrid, int dimension);
+void reportPlacement(struct workerPool *pool, double **grid, int dimension, int pinned);
+double relaxRow(const double *restrict above, const double *restrict row, const double *restrict below, double *restrict out,
+                int dimension, double maxDelta);
+double combineDeltas(struct paddedDelta *deltas, int workerThreads);
+int takeTile(struct tileDeque *deque, int tileRows, int steal, int *firstRow, int *endRow);
+double relaxTiles(struct workerPool *pool, int index, double **inGrid, double **outGrid);
+int printGrid(double **grid, int dimension);
+int relaxGrid(struct workerPool *pool, double **inGrid, double **outGrid, int dimension, double precision, int verbose);
+int swapGrids(double **fromGrid, double **toGrid, int dimension);
+
+int main(int argc, char **argv)
 {
     struct timespec start, stop;
     long long int accum;
@@ -37,43 +155,123 @@ int main()
         perror("clock gettime");
         exit(EXIT_FAILURE);
     }
-    //barriers are used to synchronise all worker threads + the main thread
-    if (pthread_barrier_init(&barrier1, NULL, (unsigned int)workerThreads + 1) != 0)
+
+    //defaults, overridden by the arguements
+    int dimension = 10;
+    double precision = 0.1;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int workerThreads = processors > 0 ? (int)processors : 1; //by default, a worker per processor
+    int runs = 1;                                              //relaxations to run back to back with the same workers
+    int verbose = 0;                                           //print the grid after every iteration (for testing)
+    const char *barrierName = NULL;                            //by default, spin if every thread has a processor to itself
+    int benchmarkBarriersTo = 0;                               //if set, time this many barriers instead of relaxing
+    int *cpus = NULL;                                          //processors to pin the workers to in turn, by default none
+    int cpuCount = 0;
+    const char *schedulerName = "static"; //by default, each worker only ever relaxes its own rows
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:p:n:r:vb:m:a:s:")) != -1)
     {
-        perror("barrier 1 init");
-        exit(EXIT_FAILURE);
+        switch (opt)
+        {
+        case 'd':
+            dimension = atoi(optarg);
+            break;
+        case 'p':
+            precision = atof(optarg);
+            break;
+        case 'n':
+            workerThreads = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'b':
+            barrierName = optarg;
+            break;
+        case 'm':
+            benchmarkBarriersTo = atoi(optarg);
+            break;
+        case 'a':
+            cpuCount = parseCpuList(optarg, &cpus);
+            break;
+        case 's':
+            schedulerName = optarg;
+            break;
+        default:
+            break;
+        }
     }
-    if (pthread_barrier_init(&barrier2, NULL, (unsigned int)workerThreads + 1) != 0)
+    int barrierKind = barrierName != NULL ? parseBarrier(barrierName) : BARRIER_SPIN;
+    int scheduler = strcmp(schedulerName, "static") == 0  ? SCHEDULER_STATIC
+                    : strcmp(schedulerName, "steal") == 0 ? SCHEDULER_STEAL
+                                                          : -1;
+    if (dimension < 3 || workerThreads < 1 || runs < 1 || barrierKind < 0 || benchmarkBarriersTo < 0 || cpuCount < 0 || scheduler < 0)
     {
-        perror("barrier 2 init");
+        fprintf(stderr, "usage: %s [-d dimension (at least 3)] [-p precision] [-n worker threads] [-r runs] [-v] "
+                        "[-b spin|pthread] [-m barriers to benchmark] [-a cpu list such as 0-7,16-23, or auto] "
+                        "[-s static|steal]\n",
+                argv[0]);
         exit(EXIT_FAILURE);
     }
+    if (benchmarkBarriersTo > 0)
+    {
+        benchmarkBarriers(workerThreads, benchmarkBarriersTo);
+        return 0;
+    }
+    //there is no point having more workers than rows to relax
+    if (workerThreads > dimension - 2)
+    {
+        workerThreads = dimension - 2;
+    }
+    //the main thread waits at the barrier too, and spinning threads that have to share a processor
+    //only hold up the threads they are waiting for, so sleep instead when there are not enough processors
+    if (barrierName == NULL && workerThreads + 1 > processors)
+    {
+        barrierKind = BARRIER_PTHREAD;
+    }
 
-    //Allocate memory to store the grids and then populate them with the desiered values
-    double *grid[dimension];
-    double *newGrid[dimension];
+    struct workerPool *pool = createPool(workerThreads, barrierKind, scheduler, cpus, cpuCount);
 
-    int l;
-    for (l = 0; l < dimension; l++)
+    //Allocate memory to store the grids
+    double **grid = allocateGrid(dimension);
+    double **newGrid = allocateGrid(dimension);
+
+    for (int run = 0; run < runs; run++)
     {
-        grid[l] = (double *)malloc((unsigned)dimension * sizeof(double));
-        newGrid[l] = (double *)malloc((unsigned)dimension * sizeof(double));
-    }
-    populateGrid(grid);
-    populateGrid(newGrid);
+        //populate the grids with the desiered values, each worker writing its own rows so they are placed in memory near it
+        populateGrids(pool, grid, newGrid, dimension);
+        if (run == 0)
+        {
+            reportPlacement(pool, grid, dimension, cpuCount > 0);
+        }
 
-   
-    //Carry out the relaxation
-    relaxGrid(grid, newGrid);
+        //Carry out the relaxation
+        int count = relaxGrid(pool, grid, newGrid, dimension, precision, verbose);
+        printf("count: %d\n", count);
+        if (scheduler == SCHEDULER_STEAL)
+        {
+            long stolen = 0;
+            for (int i = 0; i < workerThreads; i++)
+            {
+                stolen += pool->args[i].stolen;
+            }
+            printf("stolen tiles: %ld\n", stolen);
+        }
+    }
 
-    printGrid(grid);
-    //Cleanup memory
-    int k;
-    for (k = 0; k < dimension; k++)
+    if (verbose)
     {
-        free(grid[k]);
-        free(newGrid[k]);
+        printGrid(grid, dimension);
     }
+    //Cleanup memory
+    freeGrid(grid, dimension);
+    freeGrid(newGrid, dimension);
+    destroyPool(pool);
+    free(cpus);
 
     //Output timing information
     if (clock_gettime(CLOCK_MONOTONIC, &stop) == -1)
@@ -88,55 +286,170 @@ int main()
 }
 
 /**
- * Function that calculates the average of a cell's four neighbours, or when on an edge, the available neighbours
+ * Allocates a dimension x dimension grid, as an array of rows in one block of memory
+ * the values are left for populateGrids to write, so the pages are placed by whichever threads first write them
+ **/
+double **allocateGrid(int dimension)
+{
+    double **grid = (double **)malloc((unsigned)dimension * sizeof(double *));
+    double *values = (double *)malloc((size_t)dimension * (size_t)dimension * sizeof(double));
+    for (int l = 0; l < dimension; l++)
+    {
+        grid[l] = values + (size_t)l * (size_t)dimension;
+    }
+    return grid;
+}
+
+/**
+ * Frees a grid allocated by allocateGrid
+ * (swapGrids exchanges every row, so the first row always starts a block, though perhaps the other grid's)
  **/
-double relaxCell(double *grid[dimension], int row, int column)
+void freeGrid(double **grid, int dimension)
 {
-    double sum = 0;
+    (void)dimension;
+    free(grid[0]);
+    free(grid);
+}
 
-    sum = sum + grid[row - 1][column];
-    sum = sum + grid[row + 1][column];
-    sum = sum + grid[row][column - 1];
-    sum = sum + grid[row][column + 1];
-    return (sum / 4);
+/**
+ * Relaxes the cells of a row (all but the first and last) given the rows either side of it, averaging each cell's four neighbours
+ * returns the larger of maxDelta and the largest change made to any cell, so completeness is found in the same pass
+ **/
+double relaxRow(const double *restrict above, const double *restrict row, const double *restrict below, double *restrict out,
+                int dimension, double maxDelta)
+{
+    //a single running maximum would make every cell wait on the comparison for the cell before,
+    //so RELAX_LANES interleaved maxima are kept and only combined at the end of the row
+    double lanes[RELAX_LANES] = {maxDelta};
+    int t = 1;
+    for (; t + RELAX_LANES <= dimension - 1; t += RELAX_LANES)
+    {
+        for (int l = 0; l < RELAX_LANES; l++)
+        {
+            double value = (above[t + l] + below[t + l] + row[t + l - 1] + row[t + l + 1]) / 4;
+            double delta = fabs(value - row[t + l]);
+            lanes[l] = delta > lanes[l] ? delta : lanes[l];
+            out[t + l] = value;
+        }
+    }
+    for (; t < dimension - 1; t++)
+    {
+        double value = (above[t] + below[t] + row[t - 1] + row[t + 1]) / 4;
+        double delta = fabs(value - row[t]);
+        lanes[0] = delta > lanes[0] ? delta : lanes[0];
+        out[t] = value;
+    }
+    for (int l = 1; l < RELAX_LANES; l++)
+    {
+        lanes[0] = lanes[l] > lanes[0] ? lanes[l] : lanes[0];
+    }
+    return lanes[0];
 }
 
 /**
- * Fills the first row and left most columns of a 2d array with 1s
+ * Fills the rows from firstRow to endRow of a grid whose first row and left most column are 1s, and the rest 0s
  **/
-int populateGrid(double *grid[dimension])
+int populateRows(double **grid, int dimension, int firstRow, int endRow)
 {
-    for (int i = 0; i < dimension; i++)
+    for (int i = firstRow; i < endRow; i++)
     {
-        grid[i][0] = 1;
-        grid[0][i] = 1;
+        for (int j = 0; j < dimension; j++)
+        {
+            grid[i][j] = i == 0 || j == 0 ? 1 : 0;
+        }
     }
     return 0;
 }
 
 /**
- * Checks whether two grids have any corresponding cells with a difference greater than the specified precision 
+ * Combines the workers' largest changes in an iteration into the largest change made to any cell
+ * (the cells outside the workers' rows never change, so this covers the whole grid)
  **/
-int checkComplete(double *grid[dimension], double *newGrid[dimension])
+double combineDeltas(struct paddedDelta *deltas, int workerThreads)
 {
-    int i, j;
-    for (i = 0; i < dimension; i++)
+    double maxDelta = 0;
+    for (int i = 0; i < workerThreads; i++)
     {
-        for (j = 0; j < dimension; j++)
+        maxDelta = deltas[i].delta > maxDelta ? deltas[i].delta : maxDelta;
+    }
+    return maxDelta;
+}
+
+/**
+ * Takes a tile of up to tileRows rows from a worker's deque, from the start for its owner or from the end when stealing
+ * returns 1 with the tile's rows in firstRow and endRow, or 0 if there are no rows left
+ **/
+int takeTile(struct tileDeque *deque, int tileRows, int steal, int *firstRow, int *endRow)
+{
+    uint64_t rows = atomic_load_explicit(&deque->rows, memory_order_relaxed);
+    while (1)
+    {
+        int start = (int)(uint32_t)rows;
+        int end = (int)(rows >> 32);
+        if (start >= end)
+        {
+            return 0;
+        }
+        if (steal)
+        {
+            *firstRow = end - tileRows > start ? end - tileRows : start;
+            *endRow = end;
+            end = *firstRow;
+        }
+        else
+        {
+            *firstRow = start;
+            *endRow = start + tileRows < end ? start + tileRows : end;
+            start = *endRow;
+        }
+
+        //the grids themselves are handed over by the barriers, so the deque only has to be updated atomically
+        uint64_t remaining = (uint64_t)(uint32_t)end << 32 | (uint32_t)start;
+        if (atomic_compare_exchange_weak_explicit(&deque->rows, &rows, remaining, memory_order_relaxed, memory_order_relaxed))
+        {
+            return 1;
+        }
+    }
+}
+
+/**
+ * Relaxes a worker's share of an iteration with SCHEDULER_STEAL: its own rows a tile at a time, then any tiles
+ * it can steal from the other workers, visiting its neighbours first
+ * returns the largest change made to any cell the worker relaxed
+ **/
+double relaxTiles(struct workerPool *pool, int index, double **inGrid, double **outGrid)
+{
+    struct threadArgs *args = &pool->args[index];
+    int dimension = pool->dimension;
+    int workerThreads = pool->workerThreads;
+    double maxDelta = 0;
+    long stolen = 0;
+    int firstRow, endRow;
+
+    //no one steals from this deque until it is refilled, as every deque was emptied before the last barrier
+    atomic_store_explicit(&pool->deques[index].rows, (uint64_t)(uint32_t)args->endRow << 32 | (uint32_t)args->startRow,
+                          memory_order_relaxed);
+
+    for (int v = 0; v < workerThreads; v++)
+    {
+        int victim = (index + v) % workerThreads;
+        while (takeTile(&pool->deques[victim], pool->tileRows, v != 0, &firstRow, &endRow))
         {
-            if (fabs(newGrid[i][j] - grid[i][j]) > precision)
+            for (int s = firstRow; s < endRow; s++)
             {
-                return 1;
+                maxDelta = relaxRow(inGrid[s - 1], inGrid[s], inGrid[s + 1], outGrid[s], dimension, maxDelta);
             }
+            stolen += v != 0;
         }
     }
-    return 0;
+    args->stolen += stolen;
+    return maxDelta;
 }
 
 /**
  * Prints a grid out in a readable format (for testing)
  **/
-int printGrid(double *grid[dimension])
+int printGrid(double **grid, int dimension)
 {
     int k, l;
     for (k = 0; k < dimension; k++)
@@ -151,111 +464,521 @@ int printGrid(double *grid[dimension])
     return 0;
 }
 
-//Loops over its allocation until cancelled by the main thread
+/**
+ * Looks up a kind of barrier by name (spin or pthread)
+ * returns -1 if there is no barrier with that name
+ **/
+int parseBarrier(const char *name)
+{
+    return strcmp(name, "spin") == 0      ? BARRIER_SPIN
+           : strcmp(name, "pthread") == 0 ? BARRIER_PTHREAD
+                                          : -1;
+}
+
+/**
+ * Sets up a barrier of the given kind for threads threads
+ **/
+void initBarrier(struct poolBarrier *barrier, int kind, int threads)
+{
+    barrier->kind = kind;
+    if (kind == BARRIER_PTHREAD)
+    {
+        if (pthread_barrier_init(&barrier->pthreadBarrier, NULL, (unsigned int)threads) != 0)
+        {
+            perror("barrier init");
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    atomic_init(&barrier->spin.remaining, threads);
+    atomic_init(&barrier->spin.generation, 0);
+    barrier->spin.threads = threads;
+}
+
+/**
+ * Waits until all the barrier's threads have arrived
+ * as with pthread_barrier_wait, everything written before the wait is visible to every thread after it
+ **/
+void waitBarrier(struct poolBarrier *barrier)
+{
+    if (barrier->kind == BARRIER_PTHREAD)
+    {
+        pthread_barrier_wait(&barrier->pthreadBarrier);
+        return;
+    }
+
+    struct spinBarrier *spin = &barrier->spin;
+    int generation = atomic_load_explicit(&spin->generation, memory_order_relaxed);
+    if (atomic_fetch_sub_explicit(&spin->remaining, 1, memory_order_acq_rel) == 1)
+    {
+        //last to arrive, so reset the count for next time before releasing everyone else
+        atomic_store_explicit(&spin->remaining, spin->threads, memory_order_relaxed);
+        atomic_store_explicit(&spin->generation, generation + 1, memory_order_release);
+        return;
+    }
+
+    //spin while the others are likely to arrive soon, then keep yielding so threads without a processor of their own can run
+    for (int spins = 1; atomic_load_explicit(&spin->generation, memory_order_acquire) == generation; spins++)
+    {
+        if (spins % SPIN_BEFORE_YIELD == 0)
+        {
+            sched_yield();
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+/**
+ * Frees anything held by a barrier
+ **/
+void destroyBarrier(struct poolBarrier *barrier)
+{
+    if (barrier->kind == BARRIER_PTHREAD)
+    {
+        pthread_barrier_destroy(&barrier->pthreadBarrier);
+    }
+}
+
+struct benchmarkArgs
+{
+    struct poolBarrier *barrier;
+    int barriers;
+    double seconds;
+};
+
+//Waits at the barrier the given number of times, timing the waits
+void *benchmarkThread(void *dummyArgs)
+{
+    struct benchmarkArgs *args = (struct benchmarkArgs *)dummyArgs;
+    struct timespec start, stop;
+
+    //every thread has started once the first wait is over
+    waitBarrier(args->barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < args->barriers; i++)
+    {
+        waitBarrier(args->barrier);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    args->seconds = (double)(stop.tv_sec - start.tv_sec) + (double)(stop.tv_nsec - start.tv_nsec) / 1e9;
+    return NULL;
+}
+
+/**
+ * Microbenchmark of the kinds of barrier, printing the time each takes to pass with 1, 2, 4... and maxThreads threads
+ **/
+void benchmarkBarriers(int maxThreads, int barriers)
+{
+    const int kinds[] = {BARRIER_PTHREAD, BARRIER_SPIN};
+    printf("threads, pthread ns per barrier, spin ns per barrier\n");
+    for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2)
+    {
+        printf("%d", threads);
+        for (int k = 0; k < 2; k++)
+        {
+            struct poolBarrier barrier;
+            initBarrier(&barrier, kinds[k], threads);
+            pthread_t *threadIds = (pthread_t *)malloc((unsigned)threads * sizeof(pthread_t));
+            struct benchmarkArgs *args = (struct benchmarkArgs *)malloc((unsigned)threads * sizeof(struct benchmarkArgs));
+            for (int i = 0; i < threads; i++)
+            {
+                args[i].barrier = &barrier;
+                args[i].barriers = barriers;
+                if (pthread_create(&threadIds[i], NULL, benchmarkThread, &args[i]))
+                {
+                    perror("thread create");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            for (int i = 0; i < threads; i++)
+            {
+                pthread_join(threadIds[i], NULL);
+            }
+            //every thread leaves the last barrier together, so the first thread's time stands for them all
+            printf(", %.1f", args[0].seconds * 1e9 / barriers);
+            destroyBarrier(&barrier);
+            free(threadIds);
+            free(args);
+        }
+        printf("\n");
+    }
+}
+
+//Loops over its allocation of whichever relaxation the pool is working on, until the pool is stopped
 void *workerThread(void *dummyArgs)
 {
     struct threadArgs *args = (struct threadArgs *)dummyArgs;
-    //loops until cancelled by the main thread once it detects a completed relaxation
-    //using this method avoids the need for a shared variable to detect completion
+    struct workerPool *pool = args->pool;
+    int index = (int)(args - pool->args);
     while (1)
     {
-        for (int s = args->startRow; s < args->endRow; s++)
+        //wait for the main thread to set up the next relaxation (or stop the pool)
+        waitBarrier(&pool->barrier);
+        if (pool->stop)
+        {
+            return NULL;
+        }
+
+        int dimension = pool->dimension;
+        if (pool->job == JOB_POPULATE)
         {
-            for (int t = 1; t < dimension - 1; t++)
+            //the first and last workers also take the fixed rows at the edges
+            int firstRow = index == 0 ? 0 : args->startRow;
+            int endRow = index == pool->workerThreads - 1 ? dimension : args->endRow;
+            populateRows(pool->grids[0], dimension, firstRow, endRow);
+            populateRows(pool->grids[1], dimension, firstRow, endRow);
+            args->cpu = sched_getcpu();
+            waitBarrier(&pool->barrier);
+            continue;
+        }
+
+        for (int iteration = 0;; iteration++)
+        {
+            //the grids alternate roles, so nobody has to swap them between iterations
+            double **inGrid = pool->grids[iteration & 1];
+            double **outGrid = pool->grids[(iteration & 1) ^ 1];
+
+            //the largest change to the worker's rows is found as they are relaxed, rather than in a separate pass
+            double maxDelta = 0;
+            if (pool->scheduler == SCHEDULER_STEAL)
+            {
+                maxDelta = relaxTiles(pool, index, inGrid, outGrid);
+            }
+            else
             {
-                args->outGrid[s][t] = relaxCell(args->inGrid, s, t);
+                for (int s = args->startRow; s < args->endRow; s++)
+                {
+                    maxDelta = relaxRow(inGrid[s - 1], inGrid[s], inGrid[s + 1], outGrid[s], dimension, maxDelta);
+                }
+            }
+            pool->deltas[iteration & 1][index].delta = maxDelta;
+
+            //once every worker has published its change, every thread combines them and comes to the same decision,
+            //so one barrier per iteration is all that is needed
+            waitBarrier(&pool->barrier);
+            if (combineDeltas(pool->deltas[iteration & 1], pool->workerThreads) <= pool->precision)
+            {
+                break;
             }
         }
-        //first barrier ensures that all threads have computed their allocation before the main thread checks for completion
-        pthread_barrier_wait(&barrier1);
+    }
+}
 
-        //Here the main thread checks if the grid is complete:
-        //If not, inGrid is updated with the result of the previous iteration then all threads continue
-        //If it is complete, all worker threads are cancelled by the main thread whilst waiting here
-        pthread_barrier_wait(&barrier2);
+/**
+ * Parses a list of processors such as 0-7,16-23 into an array, or with auto, every processor the program may run on
+ * returns the number of processors, or -1 if the list is not valid
+ **/
+int parseCpuList(const char *list, int **cpus)
+{
+    cpu_set_t allowed;
+    int count = 0;
+    *cpus = (int *)realloc(*cpus, CPU_SETSIZE * sizeof(int));
+    if (strcmp(list, "auto") == 0)
+    {
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            return -1;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                (*cpus)[count++] = cpu;
+            }
+        }
+        return count > 0 ? count : -1;
     }
+
+    const char *next = list;
+    do
+    {
+        char *end;
+        long first = strtol(next, &end, 10);
+        long last = first;
+        if (end == next)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            next = end + 1;
+            last = strtol(next, &end, 10);
+            if (end == next)
+            {
+                return -1;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE || count + (last - first + 1) > CPU_SETSIZE)
+        {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            (*cpus)[count++] = (int)cpu;
+        }
+        next = end + (*end == ',');
+        if (*end != ',' && *end != '\0')
+        {
+            return -1;
+        }
+    } while (*next != '\0');
+    return count;
 }
 
 /**
- * Reforms a single relaxation iteration on all but the outermost rows and columns of a grid
+ * Finds the NUMA node a processor belongs to, from the nodeN entry in its sysfs directory
+ * returns -1 if it cannot be found
  **/
+int cpuNode(int cpu)
+{
+    char path[64];
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *directory = opendir(path);
+    if (directory == NULL)
+    {
+        return -1;
+    }
+    int node = -1;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(directory);
+    return node;
+}
+
+/**
+ * Starts the worker threads, which wait for jobs to be handed to them by populateGrids and relaxGrid
+ * if cpuCount is not 0, worker i is pinned to cpus[i % cpuCount] before it starts
+ **/
+struct workerPool *createPool(int workerThreads, int barrierKind, int scheduler, const int *cpus, int cpuCount)
+{
+    struct workerPool *pool = (struct workerPool *)malloc(sizeof(struct workerPool));
+    pool->workerThreads = workerThreads;
+    pool->threadIds = (pthread_t *)malloc((unsigned)workerThreads * sizeof(pthread_t));
+    pool->args = (struct threadArgs *)malloc((unsigned)workerThreads * sizeof(struct threadArgs));
+    pool->stop = 0;
+    pool->scheduler = scheduler;
+    pool->deques = (struct tileDeque *)aligned_alloc(CACHE_LINE_BYTES, (unsigned)workerThreads * sizeof(struct tileDeque));
+    for (int i = 0; i < workerThreads; i++)
+    {
+        atomic_init(&pool->deques[i].rows, 0);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        pool->deltas[i] = (struct paddedDelta *)aligned_alloc(CACHE_LINE_BYTES, (unsigned)workerThreads * sizeof(struct paddedDelta));
+    }
+
+    //the barrier is used to synchronise all worker threads + the main thread
+    initBarrier(&pool->barrier, barrierKind, workerThreads + 1);
 
-int relaxGrid(double *inGrid[dimension], double *outGrid[dimension])
+    for (int i = 0; i < workerThreads; i++)
+    {
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        if (cpuCount > 0)
+        {
+            //pinned from the start, so every page the worker first touches is placed on the node it stays on
+            cpu_set_t cpu;
+            CPU_ZERO(&cpu);
+            CPU_SET(cpus[i % cpuCount], &cpu);
+            pthread_attr_setaffinity_np(&attributes, sizeof(cpu), &cpu);
+        }
+
+        pool->args[i].pool = pool;
+        pool->args[i].cpu = -1;
+        if (pthread_create(&pool->threadIds[i], &attributes, workerThread, &pool->args[i]))
+        {
+            if (cpuCount > 0)
+            {
+                fprintf(stderr, "unable to start worker %d on cpu %d\n", i, cpus[i % cpuCount]);
+                exit(EXIT_FAILURE);
+            }
+            perror("thread create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_attr_destroy(&attributes);
+    }
+    return pool;
+}
+
+/**
+ * Stops the worker threads, letting them leave their loop rather than cancelling them, and frees the pool
+ **/
+void destroyPool(struct workerPool *pool)
 {
-    pthread_t thread_id[workerThreads];
+    //the workers are all waiting at the barrier, so they see the flag as soon as they pass it
+    pool->stop = 1;
+    waitBarrier(&pool->barrier);
+    for (int j = 0; j < pool->workerThreads; j++)
+    {
+        if (pthread_join(pool->threadIds[j], NULL) != 0)
+        {
+            perror("thread join");
+            exit(EXIT_FAILURE);
+        }
+    }
+    destroyBarrier(&pool->barrier);
+    free(pool->deltas[0]);
+    free(pool->deltas[1]);
+    free(pool->deques);
+    free(pool->threadIds);
+    free(pool->args);
+    free(pool);
+}
 
+/**
+ * Gives each worker a block of the rows to be relaxed (all but the outermost)
+ **/
+void assignRows(struct workerPool *pool, int dimension)
+{
+    int workerThreads = pool->workerThreads;
     int allocation = (dimension - 2) / workerThreads;
     int remainder = (dimension - 2) % workerThreads;
     int offset = 1;
-
-    //Build a struct to contain the arguements for each worker thread
-    //Then create the worker threads
-    struct threadArgs *argsArr[workerThreads];
-    int count = 0;
     for (int i = 0; i < workerThreads; i++)
     {
-        argsArr[i] = (struct threadArgs *)malloc(sizeof(struct threadArgs));
-
         //Splits rows across threads as evenly as possible
         //Divided equally, with the remaining rows being assigned one by one until none remain
-        argsArr[i]->startRow = i * allocation + offset;
+        pool->args[i].startRow = i * allocation + offset;
 
         if (remainder > 0)
         {
-            argsArr[i]->endRow = argsArr[i]->startRow + allocation + 1;
+            pool->args[i].endRow = pool->args[i].startRow + allocation + 1;
             offset++;
             remainder--;
         }
         else
         {
-            argsArr[i]->endRow = argsArr[i]->startRow + allocation;
+            pool->args[i].endRow = pool->args[i].startRow + allocation;
         }
+    }
+}
 
-        argsArr[i]->inGrid = inGrid;
-        argsArr[i]->outGrid = outGrid;
+/**
+ * Fills in both grids' initial values with the pool's worker threads, each writing the rows it will relax
+ * so on a machine with several NUMA nodes, each worker's rows end up in memory on its own node
+ **/
+void populateGrids(struct workerPool *pool, double **grid, double **newGrid, int dimension)
+{
+    pool->job = JOB_POPULATE;
+    pool->grids[0] = grid;
+    pool->grids[1] = newGrid;
+    pool->dimension = dimension;
+    assignRows(pool, dimension);
 
-        if (pthread_create(&thread_id[i], NULL, workerThread, argsArr[i]))
+    //one barrier starts the workers and the next sees them finish
+    waitBarrier(&pool->barrier);
+    waitBarrier(&pool->barrier);
+}
+
+/**
+ * Prints where each worker ran while populating and, by sampling its rows' pages, how much of them is on its NUMA node
+ **/
+void reportPlacement(struct workerPool *pool, double **grid, int dimension, int pinned)
+{
+    long pageBytes = sysconf(_SC_PAGESIZE);
+    printf("workers %s\n", pinned ? "pinned" : "not pinned");
+    for (int i = 0; i < pool->workerThreads; i++)
+    {
+        struct threadArgs *args = &pool->args[i];
+        int node = args->cpu >= 0 ? cpuNode(args->cpu) : -1;
+
+        //the rows are contiguous (allocateGrid), so sample pages evenly between the start of the first and the end of the last
+        char *start = (char *)grid[args->startRow];
+        size_t bytes = (size_t)(args->endRow - args->startRow) * (size_t)dimension * sizeof(double);
+        void *pages[PLACEMENT_SAMPLES];
+        int status[PLACEMENT_SAMPLES];
+        for (int k = 0; k < PLACEMENT_SAMPLES; k++)
         {
-            perror("thread create");
-            exit(EXIT_FAILURE);
+            uintptr_t address = (uintptr_t)(start + bytes * (size_t)k / PLACEMENT_SAMPLES);
+            pages[k] = (void *)(address - address % (uintptr_t)pageBytes);
         }
-    }
-    //Once worker threads are created, loop constantly until the relaxation is complete
-    while (1)
-    {
-        //once all threads have calculated their allocation check completeness
-        pthread_barrier_wait(&barrier1);
-        //if complete, destroy threads and clear arguement memory then return
-        if (!checkComplete(inGrid, outGrid))
+
+        int local = 0, known = 0;
+#ifdef SYS_move_pages
+        //with no nodes given, move_pages only reports the node each page is on
+        if (syscall(SYS_move_pages, 0, PLACEMENT_SAMPLES, pages, NULL, status, 0) == 0)
         {
-            printf("count: %d\n",count);
-            for (int j = 0; j < workerThreads; j++)
+            for (int k = 0; k < PLACEMENT_SAMPLES; k++)
             {
-                if (pthread_cancel(thread_id[j]) != 0)
-                {
-                    perror("thread cancel");
-                    exit(EXIT_FAILURE);
-                }
-            }
-            for (int k = 0; k < workerThreads; k++)
-            {
-                free(argsArr[k]);
+                known += status[k] >= 0;
+                local += status[k] >= 0 && status[k] == node;
             }
-            return 0;
         }
+#endif
+        printf("worker %d: rows %d-%d, cpu %d, node %d, %d of %d sampled pages on its node (%d placed)\n", i, args->startRow,
+               args->endRow - 1, args->cpu, node, local, PLACEMENT_SAMPLES, known);
+    }
+}
+
+/**
+ * Relaxes a grid until complete with the pool's worker threads, each relaxing a block of rows every iteration
+ * (all but the outermost rows and columns are relaxed)
+ * returns the number of iterations performed, with the final values in inGrid
+ **/
+int relaxGrid(struct workerPool *pool, double **inGrid, double **outGrid, int dimension, double precision, int verbose)
+{
+    int workerThreads = pool->workerThreads;
+
+    //hand the relaxation to the workers, they pick it up when they pass the barrier
+    pool->job = JOB_RELAX;
+    pool->grids[0] = inGrid;
+    pool->grids[1] = outGrid;
+    pool->dimension = dimension;
+    pool->precision = precision;
+    assignRows(pool, dimension);
+
+    //tiles cover about TILE_BYTES, but are cut smaller if need be so every block splits into at least MIN_TILES_PER_WORKER
+    int tileRows = TILE_BYTES / (dimension * (int)sizeof(double));
+    int blockTiles = (dimension - 2) / workerThreads / MIN_TILES_PER_WORKER;
+    tileRows = tileRows < blockTiles ? tileRows : blockTiles;
+    pool->tileRows = tileRows > 0 ? tileRows : 1;
+    for (int i = 0; i < workerThreads; i++)
+    {
+        pool->args[i].stolen = 0;
+    }
+
+    //hit barrier so worker threads start on the relaxation
+    waitBarrier(&pool->barrier);
+
+    //follow the workers through the iterations until they find the relaxation complete
+    int count = 0;
+    while (1)
+    {
+        waitBarrier(&pool->barrier);
         count++;
-        printGrid(outGrid);
-        //otherwise, update the inGrid with the result of the previous iteration
-        swapGrids(outGrid, inGrid);
-        //now hit barrier so worker threads start on next iteration
-        pthread_barrier_wait(&barrier2);
+        if (verbose)
+        {
+            //the newest values are only read by the next iteration, so they are safe to print while it runs
+            printGrid(pool->grids[count & 1], dimension);
+        }
+        if (combineDeltas(pool->deltas[(count - 1) & 1], workerThreads) <= precision)
+        {
+            break;
+        }
+    }
+
+    //the workers are now waiting at the barrier for the next relaxation
+    //an odd number of iterations leaves the newest values in outGrid, so swap them into inGrid
+    if (count & 1)
+    {
+        swapGrids(outGrid, inGrid, dimension);
     }
+    return count;
 }
 
 /**
- * Copies the values contained in one grid to another
+ * Swaps the rows held by two grids
  **/
-int swapGrids(double *fromGrid[dimension], double *toGrid[dimension])
+int swapGrids(double **fromGrid, double **toGrid, int dimension)
 {
     int i;
     double *temp;
@@ -2,7 +2,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <time.h>
+
+#include "gridGenerator.h"
 
 int dimension_start = 16000;
 int processes_start = 176;
@@ -31,46 +32,17 @@ char *openGrid(int dimension, int simple)
     else
     {
         // file doesn't exist
-        // Allocate memory for the grid
-        double **grid = (double **)malloc(sizeof(double *) * dimension);
-        int l;
-        for (l = 0; l < dimension; l++)
-        {
-            grid[l] = (double *)malloc(sizeof(double) * dimension);
-        }
-        if (simple)
-        {
-            for (int i = 0; i < dimension; i++)
-            {
-                grid[i][0] = 1;
-                grid[0][i] = 1;
-            }
-        }
-        else
-        {
-            srand(time(NULL));
-
-            for (int x = 0; x < dimension; x++)
-            {
-                for (int y = 0; y < dimension; y++)
-                {
-                    grid[x][y] = (double)(rand() % 2);
-                }
-            }
-        }
-
-        FILE *write_ptr = fopen(grid_file_name, "wb");
-        for (int x = 0; x < dimension; x++)
-        {
-            fwrite(grid[x], sizeof(double) * dimension, 1, write_ptr);
-        }
-        fclose(write_ptr);
-
-        for (int x = 0; x < dimension; x++)
+        // generate it a chunk at a time with a thread per processor, so grids bigger than memory can be written
+        // (simple grids are almost entirely 0, so they are compressed down to next to nothing)
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        if (gridGenerateFile(grid_file_name, simple ? GRID_GENERATOR_SIMPLE : GRID_GENERATOR_RANDOM, 0, dimension,
+                             simple ? GRID_CODEC_XOR_RUNS : GRID_CODEC_NONE, 0, processors > 0 ? (int)processors : 1) != 0)
         {
-            free(grid[x]);
+            // remove whatever was written, so a partial grid isn't taken as already existing next time
+            printf("Unable to write %s\n", grid_file_name);
+            unlink(grid_file_name);
+            exit(1);
         }
-        free(grid);
     }
     return grid_file_name;
 }